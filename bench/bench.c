@@ -0,0 +1,241 @@
+// Throughput benchmark for the scanner, the compiler and the VM, built and
+// run by `make bench`. Every workload is timed per phase after a few warm-up
+// rounds; the report gives the median and p99 of the repetitions, the
+// throughput at the median and the heap high-water mark above what was
+// live before the phase.
+//
+//   bench [--register-vm] [--warmup N] [--repetitions N] [file.ori...]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chunk.h"
+#include "compiler.h"
+#include "orion_memory.h"
+#include "scanner.h"
+#include "vm.h"
+
+#ifndef COUNT_INSTRUCTIONS
+#error "bench needs the VM built with -DCOUNT_INSTRUCTIONS, use `make bench`"
+#endif
+
+#define DEFAULT_WARMUP 3
+#define DEFAULT_REPETITIONS 25
+// scanner workload generated in memory, too big to keep in the repo
+#define GENERATED_SOURCE_SIZE (4 * 1024 * 1024)
+
+typedef struct {
+    const char* name;
+    char* source;
+    size_t length;
+} Workload;
+
+typedef enum {
+    PHASE_SCAN,
+    PHASE_COMPILE,
+    PHASE_RUN
+} Phase;
+
+typedef struct {
+    int warmup;
+    int repetitions;
+    VMBackend backend;
+    FILE* report;
+    FILE* diagnostics;
+} BenchOptions;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static char* generateSource(size_t size, size_t* length) {
+    static const char* terms[] = {
+        "(12.5 * 3 - 7) / 2",
+        "(1.25 + 0.75) * (4 - 2.5)",
+        "-(3.5 - 9) * 0.5",
+        "100 / 8 - 6.25 * 2",
+        "(2 * 2 * 2 * 2) - 15.5",
+    };
+    int termCount = (int)(sizeof(terms) / sizeof(terms[0]));
+
+    char* source = (char*)malloc(size + 64);
+    size_t used = 0;
+    for (int i = 0; used < size; ++i) {
+        used += (size_t)sprintf(source + used, "%s%s\n", i == 0 ? "" : "+ ",
+                                terms[i % termCount]);
+    }
+
+    *length = used;
+    return source;
+}
+
+static bool loadWorkload(const char* path, Workload* workload) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        return false;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    size_t size = (size_t)ftell(file);
+    rewind(file);
+
+    char* source = (char*)malloc(size + 1);
+    size_t read = fread(source, 1, size, file);
+    fclose(file);
+    source[read] = '\0';
+
+    const char* name = strrchr(path, '/');
+    workload->name = name != NULL ? name + 1 : path;
+    workload->source = source;
+    workload->length = read;
+    return true;
+}
+
+// one timed round of a phase, returns the work done: tokens, source bytes
+// or executed instructions
+static uint64_t runPhase(Phase phase, Workload* workload, VM* vm, Chunk* chunk,
+                         FILE* diagnostics) {
+    switch (phase) {
+        case PHASE_SCAN: {
+            Scanner scanner;
+            initScanner(&scanner, workload->source);
+            uint64_t tokens = 0;
+            while (scanToken(&scanner).type != TOKEN_EOF) {
+                tokens++;
+            }
+            return tokens + 1;
+        }
+        case PHASE_COMPILE: {
+            Chunk compiled;
+            initChunk(&compiled);
+            compileWithDiagnostics(workload->source, &compiled, diagnostics);
+            freeChunk(&compiled);
+            return workload->length;
+        }
+        case PHASE_RUN: {
+            uint64_t before = vm->instructionCount;
+            runChunk(vm, chunk);
+            return vm->instructionCount - before;
+        }
+    }
+
+    return 0;
+}
+
+static void benchPhase(BenchOptions* options, Phase phase, Workload* workload, VM* vm,
+                       Chunk* chunk) {
+    static const char* phaseNames[] = {"scan", "compile", "run"};
+    static const char* unitNames[] = {"tokens", "bytes", "instructions"};
+
+    for (int i = 0; i < options->warmup; ++i) {
+        runPhase(phase, workload, vm, chunk, options->diagnostics);
+    }
+
+    double* samples = (double*)malloc(sizeof(double) * options->repetitions);
+    MemoryStats* memory = memoryStats();
+    size_t baseBytes = memory->total.liveBytes;
+    resetMemoryPeaks(memory);
+    uint64_t units = 0;
+    for (int i = 0; i < options->repetitions; ++i) {
+        double start = now();
+        units = runPhase(phase, workload, vm, chunk, options->diagnostics);
+        samples[i] = now() - start;
+    }
+
+    qsort(samples, options->repetitions, sizeof(double), compareDoubles);
+    double median = samples[options->repetitions / 2];
+    int p99Index = (options->repetitions * 99 + 99) / 100 - 1;
+    double p99 = samples[p99Index];
+
+    double peakKiB = (double)(memory->total.peakBytes - baseBytes) / 1024.0;
+
+    fprintf(options->report, "%-18s %-8s %10.3f ms %10.3f ms %10.1f KiB %10.2f M %s/s\n",
+            workload->name, phaseNames[phase], median * 1e3, p99 * 1e3, peakKiB,
+            median > 0 ? (double)units / median / 1e6 : 0.0, unitNames[phase]);
+    free(samples);
+}
+
+static void benchWorkload(BenchOptions* options, Workload* workload, VM* vm) {
+    benchPhase(options, PHASE_SCAN, workload, vm, NULL);
+    benchPhase(options, PHASE_COMPILE, workload, vm, NULL);
+
+    Chunk chunk;
+    initChunk(&chunk);
+    if (!compileWithDiagnostics(workload->source, &chunk, options->diagnostics)) {
+        fprintf(options->report, "%-18s run      skipped, compile error\n", workload->name);
+        freeChunk(&chunk);
+        return;
+    }
+    benchPhase(options, PHASE_RUN, workload, vm, &chunk);
+    freeChunk(&chunk);
+}
+
+int main(int argc, const char* argv[]) {
+    BenchOptions options = {DEFAULT_WARMUP, DEFAULT_REPETITIONS, BACKEND_STACK, NULL, NULL};
+    int firstPath = 1;
+
+    for (; firstPath < argc && strncmp(argv[firstPath], "--", 2) == 0; ++firstPath) {
+        const char* flag = argv[firstPath];
+        if (strcmp(flag, "--register-vm") == 0) {
+            options.backend = BACKEND_REGISTER;
+        } else if (strcmp(flag, "--warmup") == 0 && firstPath + 1 < argc) {
+            options.warmup = atoi(argv[++firstPath]);
+        } else if (strcmp(flag, "--repetitions") == 0 && firstPath + 1 < argc) {
+            options.repetitions = atoi(argv[++firstPath]);
+        } else {
+            fprintf(stderr, "Usage: bench [--register-vm] [--warmup N] "
+                            "[--repetitions N] [file.ori...]\n");
+            return 64;
+        }
+    }
+    if (options.repetitions < 1) {
+        options.repetitions = 1;
+    }
+
+    // runChunk prints every result; keep that out of the report
+    options.report = fdopen(dup(fileno(stdout)), "w");
+    if (options.report == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        fprintf(stderr, "Could not redirect stdout.\n");
+        return 74;
+    }
+    options.diagnostics = stderr;
+
+    VM vm;
+    initVM(&vm);
+    vm.backend = options.backend;
+
+    fprintf(options.report, "%-18s %-8s %13s %13s %14s %10s\n", "workload", "phase", "median",
+            "p99", "peak memory", "throughput");
+
+    for (int i = firstPath; i < argc; ++i) {
+        Workload workload;
+        if (!loadWorkload(argv[i], &workload)) {
+            continue;
+        }
+        benchWorkload(&options, &workload, &vm);
+        free(workload.source);
+    }
+
+    Workload generated = {"generated", NULL, 0};
+    generated.source = generateSource(GENERATED_SOURCE_SIZE, &generated.length);
+    benchWorkload(&options, &generated, &vm);
+    free(generated.source);
+
+    freeVM(&vm);
+    fclose(options.report);
+    return 0;
+}
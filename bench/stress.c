@@ -0,0 +1,635 @@
+// Concurrency stress test, built and run by `make stress`. Generates a set
+// of distinct scripts, compiles each one on the main thread for reference,
+// then has every thread compile its own script over and over at the same
+// time and checks that each chunk and every diagnostic matches the
+// reference byte for byte. The batch compiler gets the same treatment:
+// its jobs run on the threads at once, and the .orc files they write have
+// to load back as the reference chunks. Last, expressions over inputs run
+// through runBatch and runBatchParallel on both backends, and every row has
+// to match what executeChunk gave for it alone; those that run as columns
+// go through runColumns directly as well. The memory counters are checked
+// with VMs freed out of order and a chunk that outlives its VM. Exits with
+// 1 on any mismatch.
+//
+//   stress [--threads N] [--rounds N]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "batch_compiler.h"
+#include "batch_eval.h"
+#include "bytecode_cache.h"
+#include "chunk.h"
+#include "chunk_cache.h"
+#include "columns.h"
+#include "compiler.h"
+#include "orion_memory.h"
+#include "vm.h"
+
+#define DEFAULT_THREADS 8
+#define DEFAULT_ROUNDS 20
+// terms per generated script, enough that threads overlap mid-compile
+#define SCRIPT_TERMS 2000
+// a few blocks for the parallel workers to share, and a short one at the end
+#define EVAL_ROWS (3 * BATCH_ROW_BLOCK + 100)
+#define EVAL_INPUTS 3
+
+static const char* const evalInputNames[EVAL_INPUTS] = {"a", "b", "c"};
+
+// Chunks that run as columns, chunks that have to run row by row, and
+// ones that fail on some rows or on all of them.
+static const char* const evalSources[] = {
+    "a * b + c - 3",
+    "(a - b) / (c + 0.5) > 2",
+    "(a * b + c * 3 - 7) / (a + 2) > b * 0.5 - c",
+    "-a + 1 - b * 300 + 70000",
+    "a * 1.5 <= b - 2.25",
+    "a == b",
+    "a != c * 2",
+    "a / 0",
+    "a + 1 > 3 and b",
+    "a or b",
+    "!a xor b >= c",
+    "a - nil",
+    // bools as columns of 1.0 and 0.0, which must still come out as bools
+    // and never compare equal to the numbers 1 and 0
+    "(a > b) == (b > c)",
+    "true == (a < b)",
+    "(a < b) != false",
+    "!!a",
+    "(a == b) == 1",
+    "!(a >= c) xor true",
+};
+
+static const char* const evalModes[] = {
+    "runBatch (stack)",
+    "runBatch (register)",
+    "runBatchParallel (stack)",
+    "runBatchParallel (register)",
+};
+
+// a script and what compiling it on its own gave
+typedef struct {
+    char* source;
+    size_t length;
+    char* path;
+    Chunk chunk;
+    bool compiled;
+    char* diagnostics;
+    size_t diagnosticsLength;
+} Script;
+
+typedef struct {
+    Script* scripts;
+    int rounds;
+    pthread_barrier_t start;
+    atomic_int mismatches;
+} StressRun;
+
+typedef struct {
+    StressRun* run;
+    int index;
+} StressThread;
+
+typedef struct {
+    BatchJobList* list;
+    pthread_barrier_t* start;
+    atomic_uint next;
+} BatchQueue;
+
+// xorshift, so every script is the same from run to run
+static uint32_t nextRandom(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static size_t appendTerm(char* out, uint32_t* state, int depth) {
+    static const char* operators[] = {
+        " + ", " - ", " * ", " / ", " < ", " > ", " <= ", " >= ", " == ", " != ",
+    };
+    uint32_t kind = nextRandom(state) % (depth > 3 ? 4 : 7);
+
+    switch (kind) {
+        case 0: return (size_t)sprintf(out, "%u", nextRandom(state) % 70000);
+        case 1: return (size_t)sprintf(out, "%u.%u", nextRandom(state) % 100,
+                                       nextRandom(state) % 1000);
+        case 2: return (size_t)sprintf(out, "%u", nextRandom(state) % 4);
+        case 3: return (size_t)sprintf(out, "%s", nextRandom(state) % 2 ? "true" : "false");
+        case 4: {
+            size_t length = (size_t)sprintf(out, "(");
+            length += appendTerm(out + length, state, depth + 1);
+            length += (size_t)sprintf(out + length, "%s",
+                                      operators[nextRandom(state) % 10]);
+            length += appendTerm(out + length, state, depth + 1);
+            return length + (size_t)sprintf(out + length, ")");
+        }
+        case 5: {
+            size_t length = (size_t)sprintf(out, "%s", nextRandom(state) % 2 ? "-" : "!");
+            return length + appendTerm(out + length, state, depth + 1);
+        }
+        default: {
+            size_t length = appendTerm(out, state, depth + 1);
+            length += (size_t)sprintf(out + length, "%s",
+                                      nextRandom(state) % 2 ? " and " : " or ");
+            return length + appendTerm(out + length, state, depth + 1);
+        }
+    }
+}
+
+// One long `or` of terms per line. Every fourth script has a syntax error
+// somewhere, so the diagnostics are checked as well.
+static char* generateScript(int index, size_t* length) {
+    uint32_t state = 2463534242u + (uint32_t)index * 7919u;
+    size_t capacity = SCRIPT_TERMS * 1024;
+    char* source = (char*)malloc(capacity);
+    size_t used = 0;
+    int broken = index % 4 == 3 ? (int)(nextRandom(&state) % SCRIPT_TERMS) : -1;
+
+    for (int i = 0; i < SCRIPT_TERMS; ++i) {
+        if (i > 0) {
+            used += (size_t)sprintf(source + used, " or\n");
+        }
+        used += appendTerm(source + used, &state, 0);
+        if (i == broken) {
+            used += (size_t)sprintf(source + used, " * )");
+        }
+    }
+
+    *length = used;
+    return source;
+}
+
+static bool compileCollecting(const char* source, Chunk* chunk, char** diagnostics,
+                              size_t* diagnosticsLength) {
+    FILE* stream = open_memstream(diagnostics, diagnosticsLength);
+    if (stream == NULL) {
+        fprintf(stderr, "Could not open a memory stream.\n");
+        exit(74);
+    }
+    bool compiled = compileWithDiagnostics(source, chunk, stream);
+    fclose(stream);
+    return compiled;
+}
+
+static bool sameConstants(ValueArr* a, ValueArr* b) {
+    if (a->count != b->count) {
+        return false;
+    }
+    for (uint32_t i = 0; i < a->count; ++i) {
+        Value x = a->data[i];
+        Value y = b->data[i];
+        // bit for bit, NaN constants included
+#ifdef NAN_BOXING
+        if (x != y) {
+            return false;
+        }
+#else
+        if (x.type != y.type || memcmp(&x.as, &y.as, sizeof(x.as)) != 0) {
+            return false;
+        }
+#endif
+    }
+    return true;
+}
+
+static bool sameChunk(Chunk* a, Chunk* b) {
+    return a->count == b->count
+           && memcmp(a->data, b->data, (size_t)a->count) == 0
+           && a->lineCount == b->lineCount
+           && memcmp(a->lines, b->lines, sizeof(LineRun) * (size_t)a->lineCount) == 0
+           && a->maxStackDepth == b->maxStackDepth
+           && sameConstants(&a->constants, &b->constants);
+}
+
+static bool sameDiagnostics(Script* script, const char* text, size_t length) {
+    return length == script->diagnosticsLength
+           && (length == 0 || memcmp(text, script->diagnostics, length) == 0);
+}
+
+static void* compileWorker(void* arg) {
+    StressThread* thread = (StressThread*)arg;
+    StressRun* run = thread->run;
+    Script* script = &run->scripts[thread->index];
+
+    pthread_barrier_wait(&run->start);
+    for (int round = 0; round < run->rounds; ++round) {
+        Chunk chunk;
+        initChunk(&chunk);
+        char* diagnostics = NULL;
+        size_t diagnosticsLength = 0;
+        bool compiled = compileCollecting(script->source, &chunk, &diagnostics,
+                                          &diagnosticsLength);
+
+        if (compiled != script->compiled || (compiled && !sameChunk(&chunk, &script->chunk))
+            || !sameDiagnostics(script, diagnostics, diagnosticsLength)) {
+            fprintf(stderr, "script %d, round %d: differs from its serial compile\n",
+                    thread->index, round);
+            atomic_fetch_add(&run->mismatches, 1);
+        }
+
+        free(diagnostics);
+        freeChunk(&chunk);
+    }
+    return NULL;
+}
+
+static void* batchWorker(void* arg) {
+    BatchQueue* queue = (BatchQueue*)arg;
+
+    pthread_barrier_wait(queue->start);
+    for (;;) {
+        uint32_t index = atomic_fetch_add(&queue->next, 1);
+        if (index >= queue->list->count) {
+            return NULL;
+        }
+        compileBatchJob(&queue->list->jobs[index]);
+    }
+}
+
+// Numbers for the most part, with -0 and NaN among them. Every other
+// column of rows also gets a bool and a nil input that make the arithmetic
+// fail on that row, so batches see both clean columns and failing ones.
+static Value* generateInputs(size_t rowCount) {
+    uint32_t state = 88172645u;
+    Value* inputs = (Value*)malloc(sizeof(Value) * rowCount * EVAL_INPUTS);
+
+    for (size_t row = 0; row < rowCount; ++row) {
+        Value* values = inputs + row * EVAL_INPUTS;
+        values[0] = NUMBER_VAL((double)(nextRandom(&state) % 97) - 40);
+        values[1] = NUMBER_VAL(row % 11 == 3 ? -0.0 : (double)(nextRandom(&state) % 13) * 0.5);
+        values[2] = NUMBER_VAL(row % 29 == 0 ? NAN : (double)(nextRandom(&state) % 7));
+        if (row / COLUMN_WIDTH % 2 == 1 && row % COLUMN_WIDTH == 50) {
+            values[1] = BOOL_VAL(true);
+        }
+        if (row / COLUMN_WIDTH % 2 == 1 && row % COLUMN_WIDTH == 700) {
+            values[0] = NIL_VAL;
+        }
+    }
+    return inputs;
+}
+
+static int compareRows(const char* source, const char* mode, EvalBatch* expected,
+                       EvalBatch* batch) {
+    int mismatches = 0;
+    for (size_t row = 0; row < batch->rowCount; ++row) {
+        if (batch->statuses[row] == expected->statuses[row]
+            && areValuesIdentical(batch->results[row], expected->results[row])) {
+            continue;
+        }
+        if (mismatches == 0) {
+            fprintf(stderr, "\"%s\", row %zu: %s differs from executeChunk\n", source, row,
+                    mode);
+        }
+        mismatches++;
+    }
+    return mismatches;
+}
+
+// runColumns on its own, one column of rows at a time. It may only refuse
+// a column with an input that isn't a number, and what it does take has to
+// match executeChunk row for row.
+static int compareColumns(const char* source, Chunk* chunk, const Value* inputs,
+                          EvalBatch* expected, Value* results) {
+    double* columns = (double*)malloc(sizeof(double) * (size_t)chunk->maxStackDepth
+                                      * COLUMN_WIDTH);
+    int mismatches = 0;
+
+    for (size_t start = 0; start < EVAL_ROWS; start += COLUMN_WIDTH) {
+        size_t count = start + COLUMN_WIDTH < EVAL_ROWS ? COLUMN_WIDTH : EVAL_ROWS - start;
+        const Value* column = inputs + start * EVAL_INPUTS;
+        bool numbers = true;
+        for (size_t i = 0; i < count * EVAL_INPUTS; ++i) {
+            numbers &= IS_NUMBER(column[i]);
+        }
+
+        if (!runColumns(chunk, column, count, results + start, columns)) {
+            if (numbers) {
+                fprintf(stderr, "\"%s\", row %zu: runColumns refused a column of numbers\n",
+                        source, start);
+                mismatches++;
+            }
+            continue;
+        }
+        for (size_t row = start; row < start + count; ++row) {
+            if (expected->statuses[row] != INTERPRET_OK
+                || !areValuesIdentical(results[row], expected->results[row])) {
+                fprintf(stderr, "\"%s\", row %zu: runColumns differs from executeChunk\n",
+                        source, row);
+                mismatches++;
+                break;
+            }
+        }
+    }
+
+    free(columns);
+    return mismatches;
+}
+
+// every script compiled on its own thread, all of them at once
+static int stressCompile(Script* scripts, int threadCount, int rounds) {
+    StressRun run;
+    run.scripts = scripts;
+    run.rounds = rounds;
+    atomic_init(&run.mismatches, 0);
+    pthread_barrier_init(&run.start, NULL, (unsigned)threadCount);
+
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * threadCount);
+    StressThread* jobs = (StressThread*)malloc(sizeof(StressThread) * threadCount);
+    for (int i = 0; i < threadCount; ++i) {
+        jobs[i].run = &run;
+        jobs[i].index = i;
+        if (pthread_create(&threads[i], NULL, compileWorker, &jobs[i]) != 0) {
+            fprintf(stderr, "Could not start thread %d.\n", i);
+            exit(70);
+        }
+    }
+    for (int i = 0; i < threadCount; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_barrier_destroy(&run.start);
+    free(jobs);
+    free(threads);
+    return atomic_load(&run.mismatches);
+}
+
+// The scripts as files, compiled to .orc by the batch compiler's jobs on
+// threadCount threads, then every image loaded back and compared.
+static int stressBatch(Script* scripts, int scriptCount, int threadCount) {
+    BatchJobList list = {NULL, 0, 0};
+    for (int i = 0; i < scriptCount; ++i) {
+        collectBatchJobs(&list, scripts[i].path);
+    }
+
+    BatchQueue queue;
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, (unsigned)threadCount);
+    queue.list = &list;
+    queue.start = &start;
+    atomic_init(&queue.next, 0);
+
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * threadCount);
+    for (int i = 0; i < threadCount; ++i) {
+        if (pthread_create(&threads[i], NULL, batchWorker, &queue) != 0) {
+            fprintf(stderr, "Could not start thread %d.\n", i);
+            exit(70);
+        }
+    }
+    for (int i = 0; i < threadCount; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&start);
+    free(threads);
+
+    int mismatches = 0;
+    for (uint32_t i = 0; i < list.count; ++i) {
+        BatchJob* job = &list.jobs[i];
+        Script* script = &scripts[i];
+        char* orcPath = bytecodePath(job->path);
+
+        bool same = job->readable && job->compiled == script->compiled
+                    && sameDiagnostics(script, job->diagnostics, job->diagnosticsLength);
+        if (same && script->compiled) {
+            Chunk* loaded = loadBytecodeFile(orcPath, hashSource(script->source, script->length),
+                                             script->length);
+            same = loaded != NULL && sameChunk(loaded, &script->chunk);
+            if (loaded != NULL) {
+                releaseChunk(loaded);
+            }
+        }
+        if (!same) {
+            fprintf(stderr, "%s: batch compile differs from the serial one\n", job->path);
+            mismatches++;
+        }
+
+        remove(orcPath);
+        freeString(orcPath);
+        free(job->diagnostics);
+        freeString(job->path);
+    }
+    FREE_ARRAY(MEM_COMPILER, BatchJob, list.jobs, list.capacity);
+    return mismatches;
+}
+
+// Each expression run one executeChunk per row first, which also quickens
+// the chunk, then through every batch runner with threadCount workers for
+// the parallel ones, and through runColumns directly when it runs as
+// columns. Returns the number of rows that came out different; columnCounts
+// gets how many expressions ran as each ColumnResult.
+static int stressEval(int threadCount, int columnCounts[3]) {
+    Value* inputs = generateInputs(EVAL_ROWS);
+    Value* expectedResults = (Value*)malloc(sizeof(Value) * EVAL_ROWS);
+    InterpretResult* expectedStatuses = (InterpretResult*)malloc(sizeof(InterpretResult)
+                                                                 * EVAL_ROWS);
+    Value* results = (Value*)malloc(sizeof(Value) * EVAL_ROWS);
+    InterpretResult* statuses = (InterpretResult*)malloc(sizeof(InterpretResult) * EVAL_ROWS);
+
+    VM vm;
+    initVM(&vm);
+    vm.diagnostics = NULL;
+
+    int mismatches = 0;
+    for (size_t i = 0; i < sizeof(evalSources) / sizeof(evalSources[0]); ++i) {
+        const char* source = evalSources[i];
+        Chunk chunk;
+        initChunk(&chunk);
+        if (!compileWithInputs(source, &chunk, evalInputNames, EVAL_INPUTS, stderr)) {
+            mismatches++;
+            freeChunk(&chunk);
+            continue;
+        }
+
+        EvalBatch expected = {&chunk, inputs, EVAL_ROWS, expectedResults, expectedStatuses};
+        vm.backend = BACKEND_STACK;
+        for (size_t row = 0; row < EVAL_ROWS; ++row) {
+            vm.inputs = inputs + row * EVAL_INPUTS;
+            expectedStatuses[row] = executeChunk(&vm, &chunk);
+            expectedResults[row] = expectedStatuses[row] == INTERPRET_OK ? vm.result : NIL_VAL;
+        }
+        vm.inputs = NULL;
+
+        for (int mode = 0; mode < 4; ++mode) {
+            VMBackend backend = mode % 2 == 0 ? BACKEND_STACK : BACKEND_REGISTER;
+            EvalBatch batch = {&chunk, inputs, EVAL_ROWS, results, statuses};
+            if (mode < 2) {
+                vm.backend = backend;
+                runBatch(&vm, &batch);
+            } else {
+                runBatchParallel(&batch, backend, (uint32_t)threadCount);
+            }
+            mismatches += compareRows(source, evalModes[mode], &expected, &batch);
+        }
+        if (chunk.columnResult != COLUMNS_NONE) {
+            mismatches += compareColumns(source, &chunk, inputs, &expected, results);
+        }
+        columnCounts[chunk.columnResult]++;
+        freeChunk(&chunk);
+    }
+
+    freeVM(&vm);
+    free(statuses);
+    free(results);
+    free(expectedStatuses);
+    free(expectedResults);
+    free(inputs);
+    return mismatches;
+}
+
+static int memoryMismatch(const char* what) {
+    fprintf(stderr, "memory: %s\n", what);
+    return 1;
+}
+
+// the counters have to come back to zero, and a wrapped one would show
+// as live above its peak
+static bool soundCounters(MemoryStats* stats) {
+    for (int i = 0; i < MEM_CATEGORY_COUNT; ++i) {
+        if (stats->categories[i].liveBytes > stats->categories[i].peakBytes) {
+            return false;
+        }
+    }
+    return stats->total.liveBytes <= stats->total.peakBytes;
+}
+
+// Two orders the counters used to get wrong: VMs freed in the order they
+// were made, not the reverse, and a chunk compiled before the VM that runs
+// it and freed while the VM is still alive.
+static int checkMemory(void) {
+    MemoryStats* thread = memoryStats();
+    size_t baseBytes = thread->total.liveBytes;
+    int mismatches = 0;
+
+    VM* first = (VM*)malloc(sizeof(VM));
+    VM* second = (VM*)malloc(sizeof(VM));
+    initVM(first);
+    initVM(second);
+    freeVM(first);
+    free(first);
+    freeVM(second);
+    free(second);
+
+    uint64_t allocations = thread->total.allocations;
+    Chunk* chunk = compileChunk("3 * 4");
+    if (chunk == NULL || thread->total.allocations == allocations) {
+        mismatches += memoryMismatch("compiling after both VMs went uncounted");
+    }
+
+    VM vm;
+    initVM(&vm);
+    vm.backend = BACKEND_REGISTER;
+    if (chunk != NULL) {
+        executeChunk(&vm, chunk);
+        MemoryStats* owned = chunkMemoryStats(chunk);
+        if (owned->categories[MEM_REGISTER_CODE].liveBytes == 0
+            || vm.memory.categories[MEM_REGISTER_CODE].liveBytes != 0) {
+            mismatches += memoryMismatch("register code not counted as the chunk's");
+        }
+        releaseChunk(chunk);
+    }
+    if (!soundCounters(&vm.memory)
+        || vm.memory.total.liveBytes != vm.memory.categories[MEM_STACK].liveBytes) {
+        mismatches += memoryMismatch("releasing a chunk moved the VM's counters");
+    }
+    freeVM(&vm);
+    if (vm.memory.total.liveBytes != 0) {
+        mismatches += memoryMismatch("freeVM left bytes live on the VM");
+    }
+
+    if (!soundCounters(thread) || thread->total.liveBytes != baseBytes) {
+        mismatches += memoryMismatch("the thread's live bytes did not come back");
+    }
+    return mismatches;
+}
+
+int main(int argc, const char* argv[]) {
+    int threadCount = DEFAULT_THREADS;
+    int rounds = DEFAULT_ROUNDS;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: stress [--threads N] [--rounds N]\n");
+            return 64;
+        }
+    }
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+
+    const char* tmp = getenv("TMPDIR");
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s/orion-stress-XXXXXX", tmp != NULL ? tmp : "/tmp");
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "Could not create a directory in \"%s\".\n", tmp != NULL ? tmp : "/tmp");
+        return 74;
+    }
+
+    Script* scripts = (Script*)malloc(sizeof(Script) * threadCount);
+    for (int i = 0; i < threadCount; ++i) {
+        Script* script = &scripts[i];
+        script->source = generateScript(i, &script->length);
+
+        size_t pathLength = strlen(dir) + 32;
+        script->path = (char*)malloc(pathLength);
+        snprintf(script->path, pathLength, "%s/script%04d.ori", dir, i);
+        FILE* file = fopen(script->path, "wb");
+        if (file == NULL || fwrite(script->source, 1, script->length, file) != script->length) {
+            fprintf(stderr, "Could not write \"%s\".\n", script->path);
+            return 74;
+        }
+        fclose(file);
+
+        initChunk(&script->chunk);
+        script->diagnostics = NULL;
+        script->diagnosticsLength = 0;
+        script->compiled = compileCollecting(script->source, &script->chunk,
+                                             &script->diagnostics, &script->diagnosticsLength);
+    }
+
+    int memoryMismatches = checkMemory();
+    int compileMismatches = stressCompile(scripts, threadCount, rounds);
+    int batchMismatches = stressBatch(scripts, threadCount, threadCount);
+    int columnCounts[3] = {0, 0, 0};
+    int evalMismatches = stressEval(threadCount, columnCounts);
+    // an expression set that no longer reaches the columnar path would
+    // pass without checking it
+    if (columnCounts[COLUMNS_NUMBER] == 0 || columnCounts[COLUMNS_BOOL] == 0) {
+        fprintf(stderr, "No expression ran as columns of numbers and of bools.\n");
+        evalMismatches++;
+    }
+    printf("memory:  VMs out of order, a chunk outliving its VM, %d mismatches\n",
+           memoryMismatches);
+    printf("compile: %d threads x %d rounds, %d mismatches\n", threadCount, rounds,
+           compileMismatches);
+    printf("batch:   %d scripts on %d threads, %d mismatches\n", threadCount, threadCount,
+           batchMismatches);
+    printf("eval:    %zu expressions x %d rows (%d number, %d bool columns), %d mismatches\n",
+           sizeof(evalSources) / sizeof(evalSources[0]), EVAL_ROWS,
+           columnCounts[COLUMNS_NUMBER], columnCounts[COLUMNS_BOOL], evalMismatches);
+
+    for (int i = 0; i < threadCount; ++i) {
+        remove(scripts[i].path);
+        free(scripts[i].path);
+        free(scripts[i].source);
+        free(scripts[i].diagnostics);
+        freeChunk(&scripts[i].chunk);
+    }
+    free(scripts);
+    rmdir(dir);
+
+    return memoryMismatches + compileMismatches + batchMismatches + evalMismatches > 0 ? 1 : 0;
+}
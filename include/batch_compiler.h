@@ -0,0 +1,26 @@
+#ifndef orion_batch_compiler_h
+#define orion_batch_compiler_h
+
+#include "common.h"
+
+// One input of a --compile-only run. Workers fill in diagnostics (compile
+// errors, unreadable files) so they can be printed in input order.
+typedef struct {
+    char* path;
+    char* diagnostics;
+    size_t diagnosticsLength;
+    bool compiled;
+    bool readable;
+} BatchJob;
+
+typedef struct {
+    BatchJob* jobs;
+    uint32_t count;
+    uint32_t capacity;
+} BatchJobList;
+
+int compileBatch(const char* paths[], int pathCount);
+void collectBatchJobs(BatchJobList* list, const char* path);
+void compileBatchJob(BatchJob* job);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef orion_batch_eval_h
+#define orion_batch_eval_h
+
+#include <stddef.h>
+
+#include "chunk.h"
+#include "common.h"
+#include "value.h"
+#include "vm.h"
+
+// rows a worker claims at a time in runBatchParallel
+#define BATCH_ROW_BLOCK 1024
+
+// One chunk from compileWithInputs evaluated over rowCount rows. Row r binds
+// input i to inputs[r * chunk->inputCount + i] and leaves what OP_RET
+// returned in results[r], nil when the row failed. Chunks that pass
+// analyzeColumns run a column of rows at a time (see columns.h), the rest
+// one row at a time.
+typedef struct {
+    Chunk* chunk;
+    const Value* inputs;
+    size_t rowCount;
+    Value* results;
+    // INTERPRET_OK or INTERPRET_RUNTIME_ERROR per row, or NULL
+    InterpretResult* statuses;
+} EvalBatch;
+
+size_t runBatch(VM* vm, EvalBatch* batch);
+size_t runBatchParallel(EvalBatch* batch, VMBackend backend, uint32_t workerCount);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef orion_bytecode_cache_h
+#define orion_bytecode_cache_h
+
+#include "chunk.h"
+#include "common.h"
+
+// On-disk form of a compiled chunk (.orc, written next to the .ori):
+//
+//   OrcHeader | Value constants[constantCount] | LineRun lines[lineCount]
+//             | uint8_t code[codeCount]
+//
+// Every section starts on an 8-byte boundary, so once the file is mapped
+// the chunk points straight into the pages instead of copying them out.
+// Files use the native byte order and Value layout; the header records
+// both, and a mismatch just means the file is recompiled.
+#define ORC_MAGIC          0x0043524fu  // "ORC\0" read as little-endian
+#define ORC_FORMAT_VERSION 2
+// bump whenever the opcode set or an operand encoding changes
+#define ORC_VM_VERSION     6
+
+#define ORC_FLAG_NAN_BOXING 0x1u
+
+typedef struct {
+    uint32_t magic;
+    uint16_t formatVersion;
+    uint16_t vmVersion;
+    uint32_t valueSize;
+    uint32_t flags;
+    uint64_t sourceHash;
+    uint64_t sourceLength;
+    uint32_t constantCount;
+    uint32_t lineCount;
+    uint32_t codeCount;
+    uint32_t maxStackDepth;
+} OrcHeader;
+
+uint32_t orcFlags(void);
+char* bytecodePath(const char* sourcePath);
+bool writeBytecodeFile(const char* path, Chunk* chunk, uint64_t sourceHash,
+                       size_t sourceLength);
+Chunk* loadBytecodeFile(const char* path, uint64_t sourceHash,
+                        size_t sourceLength);
+void unmapBytecodeFile(void* mapping, size_t size);
+
+#endif
@@ -8,12 +8,26 @@ typedef enum {
     OP_RET,
     OP_NIL,
     OP_CONSTANT,
+    // 24-bit big-endian constant index, once the pool outgrows OP_CONSTANT
+    OP_CONSTANT_LONG,
+    // small integral numbers carried in the code instead of the pool; the
+    // operand is a signed 8-bit or 16-bit big-endian integer
+    OP_ZERO,
+    OP_ONE,
+    OP_PUSH_I8,
+    OP_PUSH_I16,
+    // input `operand` of the row being evaluated, see batch_eval.h
+    OP_GET_INPUT,
+    OP_POP,
+    // control flow, 16-bit big-endian operand
+    OP_JUMP,
+    OP_JUMP_IF_FALSE,
+    OP_JUMP_IF_TRUE,
     // bool
     OP_TRUE,
     OP_FALSE,
     OP_NOT,
-    OP_AND,
-    OP_OR,
+    OP_TO_BOOL,
     OP_XOR,
     OP_EQUAL,
     OP_NOT_EQUAL,
@@ -23,31 +37,109 @@ typedef enum {
     OP_LESS_EQUAL,
     // unary
     OP_NEGATE,
+    // `x + 1` and `x - 1`, fused by the peephole pass
     OP_INC,
     OP_DEC,
     // binary
     OP_ADD,
     OP_SUB,
     OP_MULT,
-    OP_DIV
+    OP_DIV,
+    // superinstructions, fused by the peephole pass: the operator applied
+    // to the top of the stack and the constant in the 1-byte operand
+    OP_ADD_CONST,
+    OP_SUB_CONST,
+    OP_MULT_CONST,
+    OP_DIV_CONST,
+    OP_GREATER_CONST,
+    OP_LESS_CONST,
+    OP_GREATER_EQUAL_CONST,
+    OP_LESS_EQUAL_CONST,
+    // the same with a small integer for the right operand, carried in a
+    // signed 8-bit operand like OP_PUSH_I8's
+    OP_ADD_IMM,
+    OP_SUB_IMM,
+    OP_MULT_IMM,
+    OP_DIV_IMM,
+    OP_GREATER_IMM,
+    OP_LESS_IMM,
+    OP_GREATER_EQUAL_IMM,
+    OP_LESS_EQUAL_IMM,
+    // quickened forms, never emitted by the compiler: run() rewrites a
+    // generic operator to one of these once it has seen two numbers, and
+    // back again when the guard fails
+    OP_ADD_NUM,
+    OP_SUB_NUM,
+    OP_MULT_NUM,
+    OP_DIV_NUM,
+    OP_GREATER_NUM,
+    OP_LESS_NUM,
+    OP_GREATER_EQUAL_NUM,
+    OP_LESS_EQUAL_NUM,
+    OP_EQUAL_NUM,
+    OP_NOT_EQUAL_NUM
 } OpCode;
 
+// `count` consecutive bytes of code that came from source line `line`
+typedef struct {
+    int32_t line;
+    int32_t count;
+} LineRun;
+
+struct RegisterChunk;
+
 typedef struct {
     ValueArr constants;
-    int32_t* lines;
+    // constant -> index in constants, so repeated literals share a slot
+    ValueTable constantIndex;
+    // run-length encoded line table, a new run starts when the line changes
+    LineRun* lines;
+    int32_t lineCount;
+    int32_t lineCapacity;
     uint8_t* data;
     int32_t count;
     int32_t capacity;
+    // deepest the stack gets while running the code, so run() can reserve
+    // it up front and push without checking
+    int32_t maxStackDepth;
+    // inputs each row has to bind, see compileWithInputs
+    int32_t inputCount;
+    // a ColumnResult: whether batches can run the code a column of rows at
+    // a time, see columns.h
+    uint8_t columnResult;
+    // register form of the code, lowered on the first run with the
+    // register backend
+    struct RegisterChunk* registerCode;
+    // set when the arrays above point into a mapped .orc file, in which
+    // case the chunk is read-only and freeChunk unmaps instead of freeing
+    void* mapping;
+    size_t mappingSize;
+    // owns the arrays above unless the chunk is mapped (then NULL), see
+    // orion_memory.h
+    Arena* arena;
+    // what the chunk holds past the struct itself: the arena and the
+    // register code, wherever and under whichever VM they were allocated
+    MemoryStats memory;
 } Chunk;
 
 #define DEFAULT_CHUNK_CAPACITY 30
+#define DEFAULT_LINE_RUNS_CAPACITY 8
+// OP_CONSTANT_LONG addresses at most 2^24 constants
+#define MAX_CONSTANTS (1 << 24)
 
 void initChunk(Chunk* chunk);
 void pushChunkEl(Chunk* chunk, uint8_t new_el, int* line_number,
                  bool should_increment_line);
 uint8_t popChunkEl(Chunk* chunk);
+int32_t getLine(Chunk* chunk, int offset);
+int instructionLength(uint8_t opcode);
+int stackEffect(uint8_t opcode);
+int32_t computeMaxStackDepth(Chunk* chunk);
+size_t chunkFootprint(Chunk* chunk);
+MemoryStats* chunkMemoryStats(Chunk* chunk);
 void freeChunk(Chunk* chunk);
-void pushConstantToChunk(Chunk* chunk, Value constant, int* lineNumber);
+int addConstantToChunk(Chunk* chunk, Value constant);
+bool pushConstantToChunk(Chunk* chunk, Value constant, int* lineNumber);
 Value popConstantFromChunk(Chunk* chunk);
 
 #endif
@@ -0,0 +1,29 @@
+#ifndef orion_chunk_cache_h
+#define orion_chunk_cache_h
+
+#include "chunk.h"
+#include "common.h"
+
+// Compiled chunks keyed by a hash of their source text. The source is kept
+// too, so a hash collision can never hand back the wrong chunk.
+typedef struct {
+    uint64_t hash;
+    size_t length;
+    char* source;
+    Chunk* chunk;
+} ChunkCacheEntry;
+
+typedef struct {
+    uint32_t count;
+    uint32_t capacity;
+    ChunkCacheEntry* entries;
+} ChunkCache;
+
+#define CHUNK_CACHE_MAX_LOAD 0.75
+
+void initChunkCache(ChunkCache* cache);
+void freeChunkCache(ChunkCache* cache);
+Chunk* getCachedChunk(ChunkCache* cache, const char* source);
+uint64_t hashSource(const char* source, size_t length);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef orion_columns_h
+#define orion_columns_h
+
+#include <stddef.h>
+
+#include "chunk.h"
+#include "common.h"
+#include "value.h"
+
+// Columnar execution for batches: when a chunk is nothing but number loads,
+// inputs and operators that can't fail on numbers, runColumns() runs each
+// instruction over a column of up to COLUMN_WIDTH rows at once. Dispatch is
+// paid once per column instead of once per row, and the loops over a column
+// are plain enough for the compiler to vectorize.
+#define COLUMN_WIDTH 1024
+// deepest stack a chunk can have and still run as columns, each slot takes
+// COLUMN_WIDTH doubles of scratch
+#define COLUMN_MAX_DEPTH 64
+
+// what analyzeColumns found, kept in Chunk.columnResult
+typedef enum {
+    COLUMNS_NONE,     // control flow, nil, or a type only known at runtime
+    COLUMNS_NUMBER,
+    COLUMNS_BOOL
+} ColumnResult;
+
+ColumnResult analyzeColumns(Chunk* chunk);
+bool runColumns(Chunk* chunk, const Value* inputs, size_t rowCount, Value* results,
+                double* columns);
+
+#endif
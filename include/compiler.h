@@ -2,16 +2,46 @@
 #define orion_compiler_h
 
 #include <stdint.h>
+#include <stdio.h>
 
 #include "chunk.h"
 #include "scanner.h"
+#include "token_buffer.h"
+#include "token_ring.h"
 #include "value.h"
 
+// Where an operand's code and constants begin, so the folding pass can
+// check whether the operand compiled to a single constant and drop it.
 typedef struct {
+    int codeStart;
+    uint32_t constantStart;
+} OperandMark;
+
+// The whole state of one compilation: scanner, parser and output chunk are
+// passed to every rule, there are no globals.
+typedef struct {
+    Scanner scanner;
+    // pre-lexed tokens to walk instead of the scanner, or NULL
+    TokenBuffer* tokens;
+    TokenCursor cursor;
+    // tokens lexed on another thread, or NULL; that thread also parses
+    // the numbers, prevNumber/currNumber hold them for prev and curr
+    TokenRing* ring;
+    double prevNumber;
+    double currNumber;
+    Chunk* chunk;
+    // names an identifier can refer to, input i of each row being
+    // inputNames[i]; none outside compileWithInputs
+    const char* const* inputNames;
+    int32_t inputCount;
+    // where compile errors are reported, stderr unless collected per file
+    FILE* diagnostics;
     Token prev;
     Token curr;
     bool hadError;
     bool panicMode;
+    // left operand of the infix rule being compiled, set by parsePrecedence
+    OperandMark lhsMark;
 } Parser;
 
 typedef enum {
@@ -28,7 +58,7 @@ typedef enum {
     PREC_PRIMARY
 } Precedence;
 
-typedef void (*ParseFn)();
+typedef void (*ParseFn)(Parser* parser);
 
 typedef struct {
     ParseFn prefix;
@@ -37,26 +67,49 @@ typedef struct {
 } ParseRule;
 
 bool compile(const char* source, Chunk* chunk);
-void consume(TokenType tokenType, const char* message);
-void advanceParser();
-void emitByte(uint8_t byte);
-void emitBytes(uint8_t byte1, uint8_t byte2);
-void emitConstant(Value value);
+bool compileWithDiagnostics(const char* source, Chunk* chunk, FILE* diagnostics);
+bool compileStream(int fd, size_t windowSize, Chunk* chunk, FILE* diagnostics);
+bool compilePipelined(const char* source, Chunk* chunk, FILE* diagnostics);
+bool compileWithInputs(const char* source, Chunk* chunk, const char* const* names,
+                       int32_t nameCount, FILE* diagnostics);
+bool compileParser(Parser* parser);
+void useTokenBuffer(Parser* parser, TokenBuffer* tokens);
+void consume(Parser* parser, TokenType tokenType, const char* message);
+void advanceParser(Parser* parser);
+void emitByte(Parser* parser, uint8_t byte);
+void emitBytes(Parser* parser, uint8_t byte1, uint8_t byte2);
+void emitConstant(Parser* parser, Value value);
+void emitValue(Parser* parser, Value value);
+void emitNumber(Parser* parser, double value);
+int emitJump(Parser* parser, uint8_t instruction);
+void patchJump(Parser* parser, int offset);
 // compiling expressions
-void number();
-void string();
-void literal();
-void expression();
-void unary();
-void binary();
-void grouping();
+void number(Parser* parser);
+void string(Parser* parser);
+void literal(Parser* parser);
+void input(Parser* parser);
+void expression(Parser* parser);
+void unary(Parser* parser);
+void binary(Parser* parser);
+void and_(Parser* parser);
+void or_(Parser* parser);
+void grouping(Parser* parser);
 // util
-void endCompiler();
-void errorAt(Token* token, const char* message);
-void initParser();
-Chunk* getCurrentChunk();
-uint8_t makeConstant(Value value);
-void parsePrecedence(Precedence prec);
+void endCompiler(Parser* parser);
+void errorAt(Parser* parser, Token* token, const char* message);
+void initParser(Parser* parser, const char* source, Chunk* chunk);
+Chunk* getCurrentChunk(Parser* parser);
+uint8_t makeConstant(Parser* parser, Value value);
+void parsePrecedence(Parser* parser, Precedence prec);
 ParseRule* getRule(TokenType type);
+// constant folding
+bool tryFoldUnary(Parser* parser, TokenType operatorType, OperandMark operand);
+bool tryFoldBinary(Parser* parser, TokenType operatorType, OperandMark lhs,
+                   int lhsEnd, int rhsStart);
+OperandMark markOperand(Parser* parser);
+bool readConstantOperand(Parser* parser, int start, int end, Value* value);
+void discardOperands(Parser* parser, OperandMark mark);
+bool foldUnary(TokenType operatorType, Value operand, Value* result);
+bool foldBinary(TokenType operatorType, Value a, Value b, Value* result);
 
 #endif
@@ -2,10 +2,18 @@
 #define orion_debug_h
 
 #include "chunk.h"
+#include "register_vm.h"
 
 int disassembleInstruction(Chunk* chunk, int index);
 void disassembleChunk(Chunk* chunk, const char* name);
 int printSingleByteInstruction(const char* name, int offset);
 int printConstantInstruction(Chunk* chunk, const char* name, int offset);
+int printConstantLongInstruction(Chunk* chunk, const char* name, int offset);
+int printImmediateInstruction(Chunk* chunk, const char* name, int offset);
+int printInputInstruction(Chunk* chunk, const char* name, int offset);
+int printJumpInstruction(Chunk* chunk, const char* name, int sign, int offset);
+const char* opcodeName(uint8_t opcode);
+void disassembleRegisterChunk(RegisterChunk* code, Chunk* chunk, const char* name);
+void disassembleRegisterInstruction(RegisterChunk* code, Chunk* chunk, int index);
 
 #endif
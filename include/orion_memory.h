@@ -2,13 +2,111 @@
 #define orion_memory_h
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
-#define GROW_ARRAY(type, pointer, size)                                        \
-    (type*)reallocate(pointer, sizeof(type) * (size))
+// What an allocation is for, so the memory counters can be broken down.
+typedef enum {
+    MEM_CHUNK,          // bytecode, line tables, Chunk structs
+    MEM_CONSTANTS,      // constant pools, their dedup tables, immediates
+    MEM_STACK,
+    MEM_REGISTER_CODE,
+    MEM_COMPILER,       // scratch of a single pass, batch job tables
+    MEM_STRINGS,        // sources, paths, cached source text
+    MEM_CACHE,          // the REPL's chunk cache
+    MEM_DIAGNOSTICS,    // profiler and trace buffers
+    MEM_ARENA,          // arena bytes not handed out (yet, or any more)
+    MEM_CATEGORY_COUNT
+} MemoryCategory;
 
-#define FREE_ARRAY(type, pointer) reallocate(pointer, 0)
+// Every heap allocation goes through reallocate(), which is told the old
+// size as well as the new one so the counters below stay exact.
+#define ALLOCATE(category, type, count)                                        \
+    (type*)reallocate(category, NULL, 0, sizeof(type) * (count))
 
-void* reallocate(void* pointer, size_t size);
+#define FREE(category, type, pointer) reallocate(category, pointer, sizeof(type), 0)
+
+#define GROW_ARRAY(category, type, pointer, oldCount, newCount)                \
+    (type*)reallocate(category, pointer, sizeof(type) * (oldCount),            \
+                      sizeof(type) * (newCount))
+
+#define FREE_ARRAY(category, type, pointer, oldCount)                          \
+    reallocate(category, pointer, sizeof(type) * (oldCount), 0)
+
+typedef struct {
+    uint64_t allocations;
+    uint64_t reallocations;
+    uint64_t frees;
+    size_t liveBytes;
+    size_t peakBytes;
+} MemoryCounters;
+
+// `total` is what the heap sees. The categories split the same bytes by
+// use: memory handed out by an arena is moved from MEM_ARENA to the
+// category that asked for it, so they always add up to the total.
+typedef struct {
+    MemoryCounters total;
+    MemoryCounters categories[MEM_CATEGORY_COUNT];
+} MemoryStats;
+
+void* reallocate(MemoryCategory category, void* pointer, size_t oldSize, size_t newSize);
+// Every allocation is counted twice: in the counters of the thread making
+// it, and in those of its owner, a VM or a chunk, if one has been named
+// with useMemoryStats. Owners name themselves only for the length of a
+// call and put the previous owner back before returning, so their
+// counters can't outlive them and what they free comes off the same
+// counters it went on.
+MemoryStats* memoryStats(void);
+MemoryStats* useMemoryStats(MemoryStats* stats);
+void initMemoryStats(MemoryStats* stats);
+void resetMemoryPeaks(MemoryStats* stats);
+void printMemoryStats(MemoryStats* stats, const char* name, FILE* out);
+char* copyString(const char* chars, size_t length);
+void freeString(char* string);
+
+// Bump-pointer region for everything a compilation produces: the chunk's
+// code, line table and constant pool live in one, and freeChunk releases
+// it in one go. Freeing inside an arena is a no-op, except that the most
+// recent allocation can still grow or shrink in place, which is what the
+// doubling arrays of a chunk mostly need.
+#define ARENA_BLOCK_SIZE     4096
+#define ARENA_MAX_BLOCK_SIZE (1024 * 1024)
+#define ARENA_ALIGNMENT      _Alignof(max_align_t)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t capacity;
+    size_t used;
+    _Alignas(max_align_t) unsigned char data[];
+} ArenaBlock;
+
+typedef struct {
+    // owner the arena counts its blocks and hand-outs in, next to the
+    // thread's counters
+    MemoryStats* stats;
+    // newest first, allocations come out of the head
+    ArenaBlock* blocks;
+    void* last;
+    size_t reserved;
+    // still handed out per category, given back to MEM_ARENA by freeArena
+    size_t categoryBytes[MEM_CATEGORY_COUNT];
+    uint64_t categoryAllocations[MEM_CATEGORY_COUNT];
+} Arena;
+
+// a NULL arena falls back to reallocate(), so containers can be built
+// either way
+#define ARENA_GROW_ARRAY(arena, category, type, pointer, oldCount, newCount)   \
+    (type*)arenaReallocate(arena, category, pointer, sizeof(type) * (oldCount), \
+                           sizeof(type) * (newCount))
+
+#define ARENA_FREE_ARRAY(arena, category, type, pointer, oldCount)             \
+    arenaReallocate(arena, category, pointer, sizeof(type) * (oldCount), 0)
+
+void initArena(Arena* arena, MemoryStats* stats);
+void freeArena(Arena* arena);
+void* arenaAllocate(Arena* arena, MemoryCategory category, size_t size);
+void* arenaReallocate(Arena* arena, MemoryCategory category, void* pointer, size_t oldSize,
+                      size_t newSize);
 
 #endif
@@ -0,0 +1,12 @@
+#ifndef orion_peephole_h
+#define orion_peephole_h
+
+#include "chunk.h"
+
+void optimizeChunk(Chunk* chunk);
+uint8_t fusedConstantOp(uint8_t opcode);
+uint8_t fusedImmediateOp(uint8_t opcode);
+uint8_t fusedOneOp(uint8_t opcode);
+uint8_t fusedNotOp(uint8_t opcode);
+
+#endif
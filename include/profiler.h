@@ -0,0 +1,74 @@
+#ifndef orion_profiler_h
+#define orion_profiler_h
+
+#include <stdio.h>
+
+#include "chunk.h"
+#include "common.h"
+
+// Execution profile for `make PROFILE=1` builds: run() counts every
+// instruction it dispatches per opcode and per offset of the running chunk.
+// PROFILE_CYCLES adds rdtsc timings, sampled once every
+// PROFILE_SAMPLE_PERIOD instructions so the timer stays off the fast path.
+#define OPCODE_COUNT 256
+#define PROFILE_SAMPLE_PERIOD 64
+
+// executions of one opcode on one source line
+typedef struct {
+    int32_t line;
+    int32_t opcode;     // -1 marks an empty slot
+    int32_t offset;     // first offset seen, for finding it in the disassembly
+    uint64_t count;
+} ProfileSpot;
+
+typedef struct {
+    uint64_t opcodeCounts[OPCODE_COUNT];
+    uint64_t opcodeCycles[OPCODE_COUNT];
+    uint64_t opcodeSamples[OPCODE_COUNT];
+    // per offset of the chunk being run, folded into spots when it finishes
+    uint64_t* offsetCounts;
+    int32_t offsetCapacity;
+    // open-addressing table keyed by (line, opcode)
+    ProfileSpot* spots;
+    int32_t spotCount;
+    int32_t spotCapacity;
+#ifdef PROFILE_CYCLES
+    uint64_t tick;
+    int32_t sampledOpcode;
+    uint64_t sampleStart;
+#endif
+} Profile;
+
+void initProfile(Profile* profile);
+void freeProfile(Profile* profile);
+void profileBeginChunk(Profile* profile, Chunk* chunk);
+void profileEndChunk(Profile* profile, Chunk* chunk);
+void dumpProfile(Profile* profile, FILE* out);
+
+#ifdef PROFILE_CYCLES
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#error "PROFILE_CYCLES needs rdtsc (x86)"
+#endif
+#endif
+
+// called by run() before every instruction
+static inline void profileInstruction(Profile* profile, uint8_t opcode, int32_t offset) {
+#ifdef PROFILE_CYCLES
+    // charge the sampled instruction with the cycles up to this dispatch
+    if (profile->sampledOpcode >= 0) {
+        profile->opcodeCycles[profile->sampledOpcode] += __rdtsc() - profile->sampleStart;
+        profile->opcodeSamples[profile->sampledOpcode]++;
+        profile->sampledOpcode = -1;
+    }
+    if ((++profile->tick & (PROFILE_SAMPLE_PERIOD - 1)) == 0) {
+        profile->sampledOpcode = opcode;
+        profile->sampleStart = __rdtsc();
+    }
+#endif
+    profile->opcodeCounts[opcode]++;
+    profile->offsetCounts[offset]++;
+}
+
+#endif
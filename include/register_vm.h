@@ -0,0 +1,71 @@
+#ifndef orion_register_vm_h
+#define orion_register_vm_h
+
+#include "chunk.h"
+#include "common.h"
+#include "value.h"
+#include "vm.h"
+
+// Three-address form of a chunk, run by runRegisters() instead of run().
+// Stack slot n of the stack code becomes register n, and constants are read
+// straight from their pools instead of being pushed first.
+typedef enum {
+    REG_RET,
+    REG_MOVE,
+    // b is the target instruction, c the condition operand
+    REG_JUMP,
+    REG_JUMP_IF_FALSE,
+    REG_JUMP_IF_TRUE,
+    // dst = op b
+    REG_NOT,
+    REG_TO_BOOL,
+    REG_NEGATE,
+    // dst = b op c
+    REG_XOR,
+    REG_EQUAL,
+    REG_NOT_EQUAL,
+    REG_GREATER,
+    REG_LESS,
+    REG_GREATER_EQUAL,
+    REG_LESS_EQUAL,
+    REG_ADD,
+    REG_SUB,
+    REG_MULT,
+    REG_DIV
+} RegisterOpCode;
+
+// An operand keeps its kind in the top two bits and an index below:
+// a register, a slot of the chunk's constant pool, a slot of the
+// RegisterChunk's own immediates (small integers, bools and nil, which the
+// stack code carries in the instruction instead of the pool), or an input
+// of the row being evaluated.
+#define OPERAND_REGISTER   0u
+#define OPERAND_CONSTANT   1u
+#define OPERAND_IMMEDIATE  2u
+#define OPERAND_INPUT      3u
+#define OPERAND_KIND_SHIFT 30
+#define OPERAND_INDEX_MASK ((1u << OPERAND_KIND_SHIFT) - 1)
+#define MAKE_OPERAND(kind, index) (((uint32_t)(kind) << OPERAND_KIND_SHIFT) | (uint32_t)(index))
+
+typedef struct {
+    uint8_t op;
+    uint16_t dst;
+    uint32_t b;
+    uint32_t c;
+} RegisterInstruction;
+
+typedef struct RegisterChunk {
+    RegisterInstruction* code;
+    int32_t count;
+    int32_t capacity;
+    // offset in the stack code each instruction came from, for getLine()
+    int32_t* offsets;
+    ValueArr immediates;
+    int32_t registerCount;
+} RegisterChunk;
+
+RegisterChunk* lowerToRegisters(Chunk* chunk);
+void freeRegisterChunk(RegisterChunk* code);
+InterpretResult runRegisters(VM* vm, RegisterChunk* code);
+
+#endif
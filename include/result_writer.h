@@ -0,0 +1,33 @@
+#ifndef orion_result_writer_h
+#define orion_result_writer_h
+
+#include <stddef.h>
+
+#include "common.h"
+#include "value.h"
+
+// Buffered output for results: values are formatted by hand into a block
+// of RESULT_BUFFER_SIZE bytes that goes out in one write(2) when full or
+// flushed, instead of a printf per result. Numbers are written in the
+// shortest form that reads back as the same double ("2.5", "13", "1e+300").
+#define RESULT_BUFFER_SIZE (64 * 1024)
+// longest formatValue output plus the NUL, "-2.2250738585072014e-308"
+#define VALUE_TEXT_MAX 32
+
+typedef struct {
+    int fd;
+    char* buffer;
+    size_t used;
+    // a write failed, everything after it is dropped
+    bool failed;
+} ResultWriter;
+
+void initResultWriter(ResultWriter* writer, int fd);
+bool freeResultWriter(ResultWriter* writer);
+int formatNumber(double value, char* text);
+int formatValue(Value value, char* text);
+void writeResult(ResultWriter* writer, Value value);
+bool writeResults(ResultWriter* writer, const Value* values, size_t count);
+bool flushResultWriter(ResultWriter* writer);
+
+#endif
@@ -1,11 +1,43 @@
 #ifndef orion_parser_h
 #define orion_parser_h
+#include <stdio.h>
+
 #include "vm.h"
 
+// window size for --stream; a single token longer than this still fits,
+// the window grows for it
+#define STREAM_WINDOW_SIZE (64 * 1024)
+
+// Input read from a file descriptor through a bounded window, for sources
+// too big to hold in memory. Only the window being scanned and the one
+// holding the last token returned are alive, so a token's text stays valid
+// until the second scanToken after it: exactly while the parser holds it
+// as prev or curr.
+typedef struct {
+    int fd;
+    size_t windowSize;
+    // the bytes being scanned, NUL-terminated at limit
+    char* window;
+    size_t capacity;
+    const char* limit;
+    // the window before a refill, while a token in it is still held
+    char* held;
+    size_t heldCapacity;
+    // the last token was an error, which the parser skips without moving
+    // prev, so held outlives the next token as well
+    bool keepHeld;
+    bool atEnd;
+    bool failed;
+} SourceStream;
+
+// All scanner state lives here and is passed to every scan function, so
+// each compilation (and thread) scans with its own Scanner.
 typedef struct {
     const char* start;
     const char* current;
     int line;
+    // NULL when scanning one NUL-terminated source
+    SourceStream* stream;
 } Scanner;
 
 typedef enum {
@@ -61,31 +93,67 @@ typedef enum {
 typedef struct {
     TokenType type;
     const char* start;
+    // TOKEN_LENGTH_UNKNOWN when read back from a TokenBuffer, see tokenLength
     int length;
     int line;
 } Token;
 
+#define TOKEN_LENGTH_UNKNOWN (-1)
+
+// A script loaded for the scanner, always NUL-terminated. Regular files are
+// mapped instead of copied; pipes and stdin ("-") fall back to a buffer.
+typedef struct {
+    const char* data;
+    size_t length;
+    // read from a regular file, so it has a path a .orc can sit next to
+    bool isRegularFile;
+    void* mapping;
+    size_t mappingSize;
+} SourceFile;
+
 void repl(VM* vm);
-void runFile(VM* vm, const char* path);
+int runFile(VM* vm, const char* path);
+int runStream(VM* vm, const char* path);
 char* readFile(const char* path);
-void initScanner(const char* source);
-Token scanToken();
-bool isAtEnd();
-Token makeToken(TokenType tokenType);
-Token errorToken(const char* message);
-char advanceScanner();
-bool match(char expected);
-void skipWhitespaceAndComments();
-char peek();
-char peekNext();
-Token scanString();
-Token scanNumber();
-Token scanIdentifier();
-Token scanInterpolation();
-TokenType identifierType();
-TokenType checkKeyword(int offset, int length, const char* rest,
-                       TokenType type);
+char* readStream(FILE* file, size_t* length);
+void loadSource(const char* path, SourceFile* source);
+bool openSource(const char* path, SourceFile* source, FILE* errors);
+void releaseSource(SourceFile* source);
+void initScanner(Scanner* scanner, const char* source);
+void initStreamScanner(Scanner* scanner, SourceStream* stream, int fd, size_t windowSize);
+void freeSourceStream(SourceStream* stream);
+Token scanToken(Scanner* scanner);
+Token scanTokenAt(Scanner* scanner);
+Token scanStreamToken(Scanner* scanner);
+int tokenLength(const Token* token);
+bool isAtEnd(Scanner* scanner);
+Token makeToken(Scanner* scanner, TokenType tokenType);
+Token errorToken(Scanner* scanner, const char* message);
+char advanceScanner(Scanner* scanner);
+bool match(Scanner* scanner, char expected);
+void skipWhitespaceAndComments(Scanner* scanner);
+char peek(Scanner* scanner);
+char peekNext(Scanner* scanner);
+Token scanString(Scanner* scanner);
+Token scanNumber(Scanner* scanner);
+Token scanIdentifier(Scanner* scanner);
+Token scanInterpolation(Scanner* scanner);
+TokenType identifierType(Scanner* scanner);
+TokenType checkKeyword(Scanner* scanner, int offset, int length,
+                       const char* rest, TokenType type);
 bool isDigit(char c);
 bool isAlpha(char c);
 
+// Class bits for every byte value, so classifying a character is one load.
+#define CHAR_ALPHA 0x01 // a-z, A-Z and '_'
+#define CHAR_DIGIT 0x02
+#define CHAR_SPACE 0x04 // ' ', '\t', '\r' and '\n'
+#define CHAR_IDENTIFIER (CHAR_ALPHA | CHAR_DIGIT)
+
+extern const uint8_t charClasses[256];
+
+static inline bool hasCharClass(char c, uint8_t classes) {
+    return (charClasses[(uint8_t)c] & classes) != 0;
+}
+
 #endif
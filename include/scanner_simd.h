@@ -0,0 +1,247 @@
+#ifndef orion_scanner_simd_h
+#define orion_scanner_simd_h
+
+#include <stdint.h>
+
+#include "common.h"
+#include "scanner.h"
+
+// Bulk scanning for the scanner's inner loops: each helper looks at 16 or
+// 32 bytes per step (AVX2, SSE2 or AArch64 NEON) and falls back to a plain
+// loop elsewhere or under -DNO_SIMD_SCAN.
+//
+// The source is only known to be NUL-terminated, so every load is an
+// aligned block. An aligned block never crosses a page, and the block
+// holding the scan position is readable, so reading the bytes around it
+// (before the position, or past the NUL) can't fault. A block is only
+// left behind when it has no stop byte, and NUL always stops, so the scan
+// never walks off the end. The out-of-bounds bytes are harmless but look
+// like overflows to AddressSanitizer, hence SCAN_NO_SANITIZE.
+
+#if !defined(NO_SIMD_SCAN) && defined(__GNUC__)
+#if defined(__AVX2__)
+#define SCAN_AVX2
+#elif defined(__SSE2__)
+#define SCAN_SSE2
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define SCAN_NEON
+#endif
+#endif
+
+#if defined(SCAN_AVX2) || defined(SCAN_SSE2) || defined(SCAN_NEON)
+#define SCAN_SIMD
+#endif
+
+// byte tests for the scalar loops
+static inline bool isScanSpace(char c) {
+    return hasCharClass(c, CHAR_SPACE);
+}
+
+static inline bool isScanDigit(char c) {
+    return hasCharClass(c, CHAR_DIGIT);
+}
+
+static inline bool isScanIdentifier(char c) {
+    return hasCharClass(c, CHAR_IDENTIFIER);
+}
+
+// Most runs are a byte or two (one space, a short name), too short to pay
+// for a block load. SCAN_UNTIL steps this many bytes one at a time before
+// going wide.
+#define SCAN_SHORT_RUN 8
+
+#ifdef SCAN_SIMD
+
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+#define SCAN_NO_SANITIZE __attribute__((no_sanitize("address")))
+#else
+#define SCAN_NO_SANITIZE
+#endif
+
+#if defined(SCAN_AVX2)
+#include <immintrin.h>
+
+#define SCAN_WIDTH 32
+typedef __m256i ScanBlock;
+
+SCAN_NO_SANITIZE static inline ScanBlock scanLoad(const char* block) {
+    return _mm256_load_si256((const __m256i*)block);
+}
+
+static inline uint32_t scanEqual(ScanBlock bytes, char c) {
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(c)));
+}
+
+// bytes in [low, high], both ASCII, so the signed compares are fine
+static inline uint32_t scanRange(ScanBlock bytes, char low, char high) {
+    __m256i above = _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8((char)(low - 1)));
+    __m256i below = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(high + 1)), bytes);
+    return (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(above, below));
+}
+
+#elif defined(SCAN_SSE2)
+#include <emmintrin.h>
+
+#define SCAN_WIDTH 16
+typedef __m128i ScanBlock;
+
+SCAN_NO_SANITIZE static inline ScanBlock scanLoad(const char* block) {
+    return _mm_load_si128((const __m128i*)block);
+}
+
+static inline uint32_t scanEqual(ScanBlock bytes, char c) {
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)));
+}
+
+static inline uint32_t scanRange(ScanBlock bytes, char low, char high) {
+    __m128i above = _mm_cmpgt_epi8(bytes, _mm_set1_epi8((char)(low - 1)));
+    __m128i below = _mm_cmplt_epi8(bytes, _mm_set1_epi8((char)(high + 1)));
+    return (uint32_t)_mm_movemask_epi8(_mm_and_si128(above, below));
+}
+
+#else
+#include <arm_neon.h>
+
+#define SCAN_WIDTH 16
+typedef uint8x16_t ScanBlock;
+
+SCAN_NO_SANITIZE static inline ScanBlock scanLoad(const char* block) {
+    return vld1q_u8((const uint8_t*)block);
+}
+
+// NEON has no movemask: weight each lane by its bit and add up each half
+static inline uint32_t scanMask(uint8x16_t lanes) {
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                        1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t bits = vandq_u8(lanes, vld1q_u8(weights));
+    return (uint32_t)vaddv_u8(vget_low_u8(bits))
+         | ((uint32_t)vaddv_u8(vget_high_u8(bits)) << 8);
+}
+
+static inline uint32_t scanEqual(ScanBlock bytes, char c) {
+    return scanMask(vceqq_u8(bytes, vdupq_n_u8((uint8_t)c)));
+}
+
+static inline uint32_t scanRange(ScanBlock bytes, char low, char high) {
+    uint8x16_t offset = vsubq_u8(bytes, vdupq_n_u8((uint8_t)low));
+    return scanMask(vcleq_u8(offset, vdupq_n_u8((uint8_t)(high - low))));
+}
+#endif
+
+#if SCAN_WIDTH == 32
+#define SCAN_FULL_MASK 0xffffffffu
+#else
+#define SCAN_FULL_MASK 0xffffu
+#endif
+
+// The walk shared by every helper: STOP_BYTE(c) and STOP_MASK(bytes) mark
+// the bytes that end the run, the first one at or after p is returned.
+// When lines is not NULL the newlines passed on the way are added to it.
+#define SCAN_UNTIL(p, lines, STOP_BYTE, STOP_MASK)                              \
+    do {                                                                        \
+        for (int step = 0; step < SCAN_SHORT_RUN; ++step, ++(p)) {              \
+            char c = *(p);                                                      \
+            if (STOP_BYTE) {                                                    \
+                return (p);                                                     \
+            }                                                                   \
+            if ((lines) != NULL && c == '\n') {                                 \
+                (*(lines))++;                                                   \
+            }                                                                   \
+        }                                                                       \
+        const char* block = (const char*)((uintptr_t)(p) & ~(uintptr_t)(SCAN_WIDTH - 1)); \
+        uint32_t live = (SCAN_FULL_MASK << (uint32_t)((p) - block)) & SCAN_FULL_MASK; \
+        for (;;) {                                                              \
+            ScanBlock bytes = scanLoad(block);                                  \
+            uint32_t stop = (STOP_MASK) & live;                                 \
+            uint32_t newlines = (lines) != NULL ? scanEqual(bytes, '\n') & live : 0; \
+            if (stop != 0) {                                                    \
+                uint32_t index = (uint32_t)__builtin_ctz(stop);                 \
+                if ((lines) != NULL) {                                          \
+                    *(lines) += __builtin_popcount(newlines & ((1u << index) - 1)); \
+                }                                                               \
+                return block + index;                                           \
+            }                                                                   \
+            if ((lines) != NULL) {                                              \
+                *(lines) += __builtin_popcount(newlines);                       \
+            }                                                                   \
+            block += SCAN_WIDTH;                                                \
+            live = SCAN_FULL_MASK;                                              \
+        }                                                                       \
+    } while (false)
+
+// first byte that isn't ' ', '\t', '\r' or '\n'
+SCAN_NO_SANITIZE static inline const char* skipWhitespaceRun(const char* p, int* lines) {
+    SCAN_UNTIL(p, lines, !isScanSpace(c),
+               ~(scanEqual(bytes, ' ') | scanEqual(bytes, '\t') | scanEqual(bytes, '\r')
+                 | scanEqual(bytes, '\n')));
+}
+
+// the '\n' ending a comment, or the NUL
+SCAN_NO_SANITIZE static inline const char* findLineEnd(const char* p) {
+    SCAN_UNTIL(p, (int*)NULL, c == '\n' || c == '\0',
+               scanEqual(bytes, '\n') | scanEqual(bytes, '\0'));
+}
+
+// the closing '"' or '}', or the NUL
+SCAN_NO_SANITIZE static inline const char* findClosing(const char* p, char closing, int* lines) {
+    SCAN_UNTIL(p, lines, c == closing || c == '\0',
+               scanEqual(bytes, closing) | scanEqual(bytes, '\0'));
+}
+
+// first byte that can't continue an identifier
+SCAN_NO_SANITIZE static inline const char* skipIdentifierRun(const char* p) {
+    SCAN_UNTIL(p, (int*)NULL, !isScanIdentifier(c),
+               ~(scanRange(bytes, 'a', 'z') | scanRange(bytes, 'A', 'Z')
+                 | scanRange(bytes, '0', '9') | scanEqual(bytes, '_')));
+}
+
+SCAN_NO_SANITIZE static inline const char* skipDigitRun(const char* p) {
+    SCAN_UNTIL(p, (int*)NULL, !isScanDigit(c), ~scanRange(bytes, '0', '9'));
+}
+
+#undef SCAN_UNTIL
+
+#else
+
+static inline const char* skipWhitespaceRun(const char* p, int* lines) {
+    for (; isScanSpace(*p); ++p) {
+        if (*p == '\n') {
+            (*lines)++;
+        }
+    }
+    return p;
+}
+
+static inline const char* findLineEnd(const char* p) {
+    while (*p != '\n' && *p != '\0') {
+        p++;
+    }
+    return p;
+}
+
+static inline const char* findClosing(const char* p, char closing, int* lines) {
+    for (; *p != closing && *p != '\0'; ++p) {
+        if (*p == '\n') {
+            (*lines)++;
+        }
+    }
+    return p;
+}
+
+static inline const char* skipIdentifierRun(const char* p) {
+    while (isScanIdentifier(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static inline const char* skipDigitRun(const char* p) {
+    while (isScanDigit(*p)) {
+        p++;
+    }
+    return p;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef orion_token_buffer_h
+#define orion_token_buffer_h
+
+#include "chunk.h"
+#include "common.h"
+#include "scanner.h"
+
+// A whole source scanned up front, for `make PRELEX=1` builds: the parser
+// walks these arrays instead of calling scanToken. A token takes five
+// bytes, its type and where it starts; the line comes from a run-length
+// table and the length is only rebuilt (by scanning the lexeme again) for
+// a diagnostic.
+typedef struct {
+    const char* source;
+    uint8_t* types;
+    // into source, or into messages for a TOKEN_ERROR
+    uint32_t* offsets;
+    uint32_t count;
+    uint32_t capacity;
+    // a new run starts with the first token of each line
+    LineRun* lines;
+    int32_t lineCount;
+    int32_t lineCapacity;
+    const char** messages;
+    uint32_t messageCount;
+    uint32_t messageCapacity;
+} TokenBuffer;
+
+// the parser's position in a TokenBuffer
+typedef struct {
+    uint32_t next;
+    int32_t run;
+    uint32_t runEnd;
+} TokenCursor;
+
+// offsets are 32 bits
+#define TOKEN_BUFFER_MAX_SOURCE UINT32_MAX
+
+void initTokenBuffer(TokenBuffer* tokens);
+void freeTokenBuffer(TokenBuffer* tokens);
+void pushToken(TokenBuffer* tokens, Token token);
+void lexTokens(TokenBuffer* tokens, const char* source);
+void initTokenCursor(TokenCursor* cursor, TokenBuffer* tokens);
+// the EOF token again once the end is reached
+Token readToken(TokenBuffer* tokens, TokenCursor* cursor);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef orion_token_ring_h
+#define orion_token_ring_h
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "common.h"
+#include "scanner.h"
+
+// Lexing on a second thread for big scripts: a producer thread scans the
+// source into fixed token blocks and hands them over through a
+// single-producer/single-consumer ring, while the compiling thread reads
+// them. The producer also converts number literals, strtod being the
+// bigger part of the work. Below PIPELINE_MIN_SOURCE bytes the thread costs more than it
+// saves and runFile compiles on one thread.
+#define PIPELINE_MIN_SOURCE (1024 * 1024)
+#define TOKEN_BLOCK_SIZE 4096
+#define TOKEN_RING_BLOCKS 8
+// a block is handed over early once it holds this many error tokens
+#define TOKEN_BLOCK_ERRORS 16
+
+typedef struct {
+    uint32_t count;
+    uint8_t types[TOKEN_BLOCK_SIZE];
+    // into the source, or into errors for a TOKEN_ERROR
+    uint32_t offsets[TOKEN_BLOCK_SIZE];
+    int32_t lines[TOKEN_BLOCK_SIZE];
+    // the value of each TOKEN_NUMBER
+    double numbers[TOKEN_BLOCK_SIZE];
+    uint32_t errorCount;
+    const char* errors[TOKEN_BLOCK_ERRORS];
+} TokenBlock;
+
+typedef struct {
+    const char* source;
+    TokenBlock* blocks;
+    pthread_t producer;
+    // Blocks filled and blocks released so far; they only grow, and block
+    // n lives in slot n % TOKEN_RING_BLOCKS. Each is written by one side
+    // only, on its own cache line.
+    _Alignas(64) atomic_uint produced;
+    _Alignas(64) atomic_uint consumed;
+    // set by the consumer when it stops early, e.g. after a compile error
+    atomic_bool cancelled;
+    // consumer side
+    _Alignas(64) TokenBlock* block;
+    uint32_t next;
+} TokenRing;
+
+bool startTokenRing(TokenRing* ring, const char* source);
+void stopTokenRing(TokenRing* ring);
+// the EOF token again once the end is reached; a number token's value is
+// stored in number
+Token readRingToken(TokenRing* ring, double* number);
+
+#endif
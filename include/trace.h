@@ -0,0 +1,75 @@
+#ifndef orion_trace_h
+#define orion_trace_h
+
+#include "chunk.h"
+#include "common.h"
+#include "value.h"
+
+// Execution trace for `make TRACE=1` builds. run() writes one fixed-size
+// record per instruction into a ring buffer instead of printing it, and
+// runtimeError() dumps the last TRACE_CAPACITY of them to TRACE_FILE (or
+// $ORION_TRACE), with an .orc image of the chunk next to it. The decoder,
+// `orion --decode-trace <file>`, is in every build and renders the records
+// through debug.c.
+//
+//   TraceHeader | TraceRecord records[recordCount], oldest first
+#define TRACE_CAPACITY 4096
+#define TRACE_FILE     "orion.trace"
+#define TRACE_MAGIC    0x0054524fu  // "ORT\0" read as little-endian
+#define TRACE_VERSION  2
+
+// Written to the file as it is, so every byte is a field: the top is kept
+// as its valueBits and type rather than as a Value, whose padding is
+// garbage, and the tail stays zero from initTrace.
+typedef struct {
+    // stack depth and top before the instruction ran, top is nil when empty
+    uint64_t top;
+    uint32_t offset;
+    uint32_t depth;
+    // as dispatched; the chunk image may hold its quickened form
+    uint8_t opcode;
+    // a ValueType, always VAL_NIL under NAN_BOXING where the bits carry it
+    uint8_t topType;
+    uint8_t unused[6];
+} TraceRecord;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t valueSize;
+    uint32_t flags;
+    uint32_t recordCount;
+    // instructions run in total, recordCount of them kept
+    uint64_t instructionCount;
+    // the chunk image is stored under this code hash, see dumpTrace
+    uint64_t codeHash;
+    uint64_t codeLength;
+} TraceHeader;
+
+typedef struct {
+    TraceRecord* records;
+    uint64_t count;
+} TraceBuffer;
+
+void initTrace(TraceBuffer* trace);
+void freeTrace(TraceBuffer* trace);
+void resetTrace(TraceBuffer* trace);
+bool dumpTrace(TraceBuffer* trace, Chunk* chunk, const char* path);
+int decodeTrace(const char* path);
+
+// called by run() before every instruction
+static inline void traceInstruction(TraceBuffer* trace, uint8_t opcode, uint32_t offset,
+                                    uint32_t depth, Value top) {
+    TraceRecord* record = &trace->records[trace->count++ & (TRACE_CAPACITY - 1)];
+    record->top = valueBits(top);
+    record->offset = offset;
+    record->depth = depth;
+    record->opcode = opcode;
+#ifdef NAN_BOXING
+    record->topType = VAL_NIL;
+#else
+    record->topType = (uint8_t)top.type;
+#endif
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define orion_value_h
 
 #include "common.h"
+#include "orion_memory.h"
 
 typedef enum {
     VAL_BOOL,
@@ -9,6 +10,51 @@ typedef enum {
     VAL_NUMBER
 } ValueType;
 
+#ifdef NAN_BOXING
+
+#include <string.h>
+
+// Non-number values live in the payload of a quiet NaN: QNAN marks the
+// value as boxed and the low bits carry the tag, so a Value is one 8-byte
+// word and every type check is a mask compare.
+typedef uint64_t Value;
+
+#define SIGN_BIT          ((uint64_t)0x8000000000000000)
+#define QNAN              ((uint64_t)0x7ffc000000000000)
+
+#define TAG_NIL           1
+#define TAG_FALSE         2
+#define TAG_TRUE          3
+
+#define FALSE_VAL         ((Value)(uint64_t)(QNAN | TAG_FALSE))
+#define TRUE_VAL          ((Value)(uint64_t)(QNAN | TAG_TRUE))
+
+#define IS_BOOL(value)    (((value) | 1) == TRUE_VAL)
+#define IS_NIL(value)     ((value) == NIL_VAL)
+#define IS_NUMBER(value)  (((value) & QNAN) != QNAN)
+#define ARE_NUMBERS(a, b) ((((a) & QNAN) != QNAN) & (((b) & QNAN) != QNAN))
+
+#define AS_BOOL(value)    ((value) == TRUE_VAL)
+#define AS_NUMBER(value)  valueToNum(value)
+
+#define BOOL_VAL(value)   ((value) ? TRUE_VAL : FALSE_VAL)
+#define NIL_VAL           ((Value)(uint64_t)(QNAN | TAG_NIL))
+#define NUMBER_VAL(value) numToValue(value)
+
+static inline double valueToNum(Value value) {
+    double num;
+    memcpy(&num, &value, sizeof(Value));
+    return num;
+}
+
+static inline Value numToValue(double num) {
+    Value value;
+    memcpy(&value, &num, sizeof(double));
+    return value;
+}
+
+#else
+
 typedef struct {
     ValueType type;
     union {
@@ -20,6 +66,7 @@ typedef struct {
 #define IS_BOOL(value)    ((value).type == VAL_BOOL)
 #define IS_NIL(value)     ((value).type == VAL_NIL)
 #define IS_NUMBER(value)  ((value).type == VAL_NUMBER)
+#define ARE_NUMBERS(a, b) (((a).type == VAL_NUMBER) & ((b).type == VAL_NUMBER))
 
 #define AS_BOOL(value)    ((value).as.boolean)
 #define AS_NUMBER(value)  ((value).as.number)
@@ -27,23 +74,53 @@ typedef struct {
 #define BOOL_VAL(value)   ((Value){VAL_BOOL, {.boolean = value}})
 #define NIL_VAL           ((Value){VAL_NIL, {.number = 0}})
 #define NUMBER_VAL(value) ((Value){VAL_NUMBER, {.number = value}})
+#endif
 
 typedef struct {
-    uint8_t count;
+    uint32_t count;
     uint32_t capacity;
     Value* data;
+    // NULL for a heap array
+    Arena* arena;
 } ValueArr;
 
 #define DEFAULT_VALUE_ARR_CAPACITY 32
 
-void initValueArr(ValueArr* valueArr);
+// Open-addressing map from the exact bit pattern of a Value to its slot in
+// a ValueArr. Keys are compared bitwise, so 0 and -0 or two NaNs with
+// different payloads stay distinct.
+typedef struct {
+    Value key;
+    int32_t index;
+} ValueTableEntry;
+
+typedef struct {
+    uint32_t count;
+    uint32_t capacity;
+    ValueTableEntry* entries;
+    Arena* arena;
+} ValueTable;
+
+#define VALUE_TABLE_EMPTY     (-1)
+#define VALUE_TABLE_MAX_LOAD  0.75
+
+void initValueArr(ValueArr* valueArr, Arena* arena);
 void pushValueArrEl(ValueArr* valueArr, Value new_el);
 Value popValueArrEl(ValueArr* valueArr);
 void freeValueArr(ValueArr* valueArr);
 void printValueArr(ValueArr* valueArr);
+void printValue(Value value);
 bool isValueArrFull(ValueArr* valueArr);
 bool areValuesEqual(Value a, Value b);
+bool areValuesIdentical(Value a, Value b);
+uint64_t valueBits(Value value);
 bool isFalseyValue(Value val);
 bool toBool(Value val);
 
+void initValueTable(ValueTable* table, Arena* arena);
+void freeValueTable(ValueTable* table);
+int32_t valueTableGet(ValueTable* table, Value key);
+void valueTableSet(ValueTable* table, Value key, int32_t index);
+void valueTableDelete(ValueTable* table, Value key);
+
 #endif
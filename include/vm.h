@@ -1,8 +1,18 @@
 #ifndef clox_vm_h
 #define clox_vm_h
 
+#include <stdio.h>
+
 #include "chunk.h"
+#include "orion_memory.h"
+#include "result_writer.h"
 #include "value.h"
+#ifdef PROFILE
+#include "profiler.h"
+#endif
+#ifdef TRACE
+#include "trace.h"
+#endif
 
 #define STACK_DEF_CAP 256
 
@@ -12,10 +22,44 @@ typedef struct {
     Value* data;
 } Stack;
 
+typedef enum {
+    BACKEND_STACK,
+    // three-address code from register_vm.c, for comparing the two
+    BACKEND_REGISTER
+} VMBackend;
+
 typedef struct {
     Chunk* chunk;
     uint8_t* ip;
     Stack stack;
+    VMBackend backend;
+    // what OP_RET returned on the last successful run
+    Value result;
+    // where runChunk writes results, or NULL to print them with printValue
+    ResultWriter* output;
+    // the row OP_GET_INPUT reads from, chunk->inputCount values
+    const Value* inputs;
+    // where runtime errors go, stderr by default; NULL drops them
+    FILE* diagnostics;
+    // off when other threads run the same chunk: run() then leaves the
+    // code as it is instead of quickening it
+    bool quicken;
+    // what the VM allocates for itself: its stack, batch scratch, and the
+    // profile and trace buffers. Chunks keep their own, see Chunk.memory,
+    // and the thread's counters see both (memoryStats).
+    MemoryStats memory;
+#ifdef COUNT_INSTRUCTIONS
+    // instructions dispatched by either backend, for bench/
+    uint64_t instructionCount;
+#endif
+#ifdef PROFILE
+    // dumped to stderr by freeVM
+    Profile profile;
+#endif
+#ifdef TRACE
+    // stack backend only, dumped by runtimeError
+    TraceBuffer trace;
+#endif
 } VM;
 
 typedef enum {
@@ -26,9 +70,20 @@ typedef enum {
 
 void initVM(VM* vm);
 InterpretResult interpretChunk(VM* vm, const char* source);
+// compile once, run many: the chunk is owned by the caller and can be run
+// any number of times. run() only rewrites opcodes into their quickened
+// forms, which behave the same.
+Chunk* compileChunk(const char* source);
+Chunk* compileLargeChunk(const char* source);
+// runChunk prints the result, executeChunk only leaves it in vm->result
+InterpretResult runChunk(VM* vm, Chunk* chunk);
+InterpretResult executeChunk(VM* vm, Chunk* chunk);
+void releaseChunk(Chunk* chunk);
 InterpretResult run(VM* vm);
 void freeVM(VM* vm);
+MemoryStats* vmMemoryStats(VM* vm);
 void initStack(Stack* stack);
+void reserveStack(Stack* stack, uint32_t depth);
 void pushStack(Stack* stack, Value value);
 Value popStack(Stack* stack);
 Value peekStack(Stack* stack, int distance);
@@ -0,0 +1,200 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "batch_compiler.h"
+#include "bytecode_cache.h"
+#include "chunk.h"
+#include "chunk_cache.h"
+#include "compiler.h"
+#include "orion_memory.h"
+#include "scanner.h"
+
+typedef struct {
+    BatchJobList* list;
+    atomic_uint next;
+} BatchQueue;
+
+static void addBatchJob(BatchJobList* list, const char* path) {
+    if (list->count == list->capacity) {
+        uint32_t oldCapacity = list->capacity;
+        list->capacity = oldCapacity == 0 ? 16 : oldCapacity * 2;
+        list->jobs = GROW_ARRAY(MEM_COMPILER, BatchJob, list->jobs, oldCapacity, list->capacity);
+    }
+
+    BatchJob* job = &list->jobs[list->count++];
+    job->path = copyString(path, strlen(path));
+    job->diagnostics = NULL;
+    job->diagnosticsLength = 0;
+    job->compiled = false;
+    job->readable = true;
+}
+
+static bool hasSourceExtension(const char* name) {
+    size_t length = strlen(name);
+    return length > 4 && strcmp(name + length - 4, ".ori") == 0;
+}
+
+static int compareNames(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+// A directory contributes every .ori below it, in name order so the output
+// is the same from run to run. Anything else is taken as a script path.
+void collectBatchJobs(BatchJobList* list, const char* path) {
+    struct stat st;
+    DIR* dir = NULL;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode) || (dir = opendir(path)) == NULL) {
+        addBatchJob(list, path);
+        return;
+    }
+
+    char** names = NULL;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    struct dirent* entry;
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        if (count == capacity) {
+            uint32_t oldCapacity = capacity;
+            capacity = capacity == 0 ? 16 : capacity * 2;
+            names = GROW_ARRAY(MEM_STRINGS, char*, names, oldCapacity, capacity);
+        }
+
+        size_t length = strlen(path) + strlen(entry->d_name) + 2;
+        names[count] = ALLOCATE(MEM_STRINGS, char, length);
+        snprintf(names[count], length, "%s/%s", path, entry->d_name);
+        count++;
+    }
+    closedir(dir);
+
+    qsort(names, count, sizeof(char*), compareNames);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (stat(names[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+            collectBatchJobs(list, names[i]);
+        } else if (hasSourceExtension(names[i])) {
+            addBatchJob(list, names[i]);
+        }
+        freeString(names[i]);
+    }
+
+    FREE_ARRAY(MEM_STRINGS, char*, names, capacity);
+}
+
+// Compiles one script into its .orc, with diagnostics captured in memory.
+void compileBatchJob(BatchJob* job) {
+    FILE* diagnostics = open_memstream(&job->diagnostics, &job->diagnosticsLength);
+    if (diagnostics == NULL) {
+        diagnostics = stderr;
+    }
+
+    SourceFile source;
+    if (!openSource(job->path, &source, diagnostics)) {
+        job->readable = false;
+    } else {
+        Chunk chunk;
+        initChunk(&chunk);
+
+        job->compiled = compileWithDiagnostics(source.data, &chunk, diagnostics);
+        if (job->compiled) {
+            char* cachePath = bytecodePath(job->path);
+            uint64_t hash = hashSource(source.data, source.length);
+            if (!writeBytecodeFile(cachePath, &chunk, hash, source.length)) {
+                fprintf(diagnostics, "Could not write \"%s\".\n", cachePath);
+                job->readable = false;
+            }
+            freeString(cachePath);
+        }
+
+        freeChunk(&chunk);
+        releaseSource(&source);
+    }
+
+    if (diagnostics != stderr) {
+        fclose(diagnostics);
+    }
+}
+
+static void* batchWorker(void* arg) {
+    BatchQueue* queue = (BatchQueue*)arg;
+
+    for (;;) {
+        uint32_t index = atomic_fetch_add(&queue->next, 1);
+        if (index >= queue->list->count) {
+            return NULL;
+        }
+        compileBatchJob(&queue->list->jobs[index]);
+    }
+}
+
+// --compile-only: precompiles every script on a pool of one worker per
+// core, then prints each file's diagnostics in input order. Returns the
+// process exit code: 74 if a file couldn't be read or written, else 65 if
+// one failed to compile.
+int compileBatch(const char* paths[], int pathCount) {
+    BatchJobList list = {NULL, 0, 0};
+    for (int i = 0; i < pathCount; ++i) {
+        collectBatchJobs(&list, paths[i]);
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t workerCount = cores > 0 ? (uint32_t)cores : 1;
+    if (workerCount > list.count) {
+        workerCount = list.count;
+    }
+
+    BatchQueue queue;
+    queue.list = &list;
+    atomic_init(&queue.next, 0);
+
+    uint32_t workerSlots = workerCount > 0 ? workerCount : 1;
+    pthread_t* workers = ALLOCATE(MEM_COMPILER, pthread_t, workerSlots);
+    uint32_t started = 0;
+    for (; started < workerCount; ++started) {
+        if (pthread_create(&workers[started], NULL, batchWorker, &queue) != 0) {
+            break;
+        }
+    }
+    // no threads at all still makes progress on this one
+    if (started == 0) {
+        batchWorker(&queue);
+    }
+    for (uint32_t i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    FREE_ARRAY(MEM_COMPILER, pthread_t, workers, workerSlots);
+
+    int status = 0;
+    for (uint32_t i = 0; i < list.count; ++i) {
+        BatchJob* job = &list.jobs[i];
+        if (job->diagnosticsLength > 0) {
+            fprintf(stderr, "%s:\n", job->path);
+            fwrite(job->diagnostics, 1, job->diagnosticsLength, stderr);
+        }
+
+        if (!job->readable) {
+            status = 74;
+        } else if (!job->compiled && status == 0) {
+            status = 65;
+        }
+
+        // open_memstream's buffer comes from libc's malloc
+        free(job->diagnostics);
+        freeString(job->path);
+    }
+    FREE_ARRAY(MEM_COMPILER, BatchJob, list.jobs, list.capacity);
+
+    return status;
+}
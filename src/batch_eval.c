@@ -0,0 +1,171 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "batch_eval.h"
+#include "chunk.h"
+#include "columns.h"
+#include "orion_memory.h"
+#include "register_vm.h"
+#include "value.h"
+#include "vm.h"
+
+typedef struct {
+    EvalBatch* batch;
+    VMBackend backend;
+    // first row no worker has claimed yet
+    atomic_size_t next;
+    atomic_size_t failed;
+} BatchRows;
+
+static size_t runRows(VM* vm, EvalBatch* batch, size_t first, size_t last) {
+    size_t width = (size_t)batch->chunk->inputCount;
+    size_t failed = 0;
+
+    for (size_t row = first; row < last; ++row) {
+        vm->inputs = width > 0 ? batch->inputs + row * width : NULL;
+        InterpretResult result = executeChunk(vm, batch->chunk);
+        batch->results[row] = result == INTERPRET_OK ? vm->result : NIL_VAL;
+        if (batch->statuses != NULL) {
+            batch->statuses[row] = result;
+        }
+        failed += result != INTERPRET_OK;
+    }
+
+    vm->inputs = NULL;
+    return failed;
+}
+
+// scratch for runColumns, or NULL when the chunk has to run row by row
+static double* allocateColumns(Chunk* chunk) {
+    if (chunk->columnResult == COLUMNS_NONE) {
+        return NULL;
+    }
+    return ALLOCATE(MEM_STACK, double, (size_t)chunk->maxStackDepth * COLUMN_WIDTH);
+}
+
+static void freeColumns(Chunk* chunk, double* columns) {
+    if (columns != NULL) {
+        FREE_ARRAY(MEM_STACK, double, columns, (size_t)chunk->maxStackDepth * COLUMN_WIDTH);
+    }
+}
+
+// Rows [first, last) a column at a time where the chunk allows it; a column
+// with an input that isn't a number runs row by row instead, which reports
+// the error.
+static size_t runBlock(VM* vm, EvalBatch* batch, double* columns, size_t first, size_t last) {
+    if (columns == NULL) {
+        return runRows(vm, batch, first, last);
+    }
+
+    size_t width = (size_t)batch->chunk->inputCount;
+    size_t failed = 0;
+    for (size_t start = first; start < last; start += COLUMN_WIDTH) {
+        size_t end = start + COLUMN_WIDTH < last ? start + COLUMN_WIDTH : last;
+        const Value* inputs = width > 0 ? batch->inputs + start * width : NULL;
+        if (!runColumns(batch->chunk, inputs, end - start, batch->results + start, columns)) {
+            failed += runRows(vm, batch, start, end);
+            continue;
+        }
+        if (batch->statuses != NULL) {
+            for (size_t row = start; row < end; ++row) {
+                batch->statuses[row] = INTERPRET_OK;
+            }
+        }
+    }
+    return failed;
+}
+
+// Runs every row on vm, one after the other, and returns how many failed.
+// Their errors go to vm->diagnostics, set it to NULL to only count them.
+size_t runBatch(VM* vm, EvalBatch* batch) {
+    MemoryStats* previous = useMemoryStats(&vm->memory);
+    double* columns = allocateColumns(batch->chunk);
+    size_t failed = runBlock(vm, batch, columns, 0, batch->rowCount);
+    freeColumns(batch->chunk, columns);
+    useMemoryStats(previous);
+    return failed;
+}
+
+// Every worker keeps its own VM, so the only state they share is the
+// chunk, which is read-only while they run.
+static void* batchEvalWorker(void* arg) {
+    BatchRows* rows = (BatchRows*)arg;
+    EvalBatch* batch = rows->batch;
+
+    VM vm;
+    initVM(&vm);
+    vm.backend = rows->backend;
+    vm.quicken = false;
+    // errors from several threads would interleave, statuses tell which
+    // rows failed
+    vm.diagnostics = NULL;
+
+    MemoryStats* previous = useMemoryStats(&vm.memory);
+    double* columns = allocateColumns(batch->chunk);
+    size_t failed = 0;
+    for (;;) {
+        size_t first = atomic_fetch_add(&rows->next, BATCH_ROW_BLOCK);
+        if (first >= batch->rowCount) {
+            break;
+        }
+        size_t last = first + BATCH_ROW_BLOCK < batch->rowCount ? first + BATCH_ROW_BLOCK
+                                                                : batch->rowCount;
+        failed += runBlock(&vm, batch, columns, first, last);
+    }
+
+    atomic_fetch_add(&rows->failed, failed);
+    freeColumns(batch->chunk, columns);
+    useMemoryStats(previous);
+    freeVM(&vm);
+    return NULL;
+}
+
+// The same split over workerCount threads (one per core when 0), each
+// claiming BATCH_ROW_BLOCK rows at a time. Runtime errors are not
+// reported, only counted and recorded in statuses.
+size_t runBatchParallel(EvalBatch* batch, VMBackend backend, uint32_t workerCount) {
+    // lowered here, once, rather than by whichever worker gets there first
+    if (backend == BACKEND_REGISTER && batch->chunk->registerCode == NULL) {
+        batch->chunk->registerCode = lowerToRegisters(batch->chunk);
+    }
+    if (batch->chunk->registerCode == NULL) {
+        backend = BACKEND_STACK;
+    }
+
+    if (workerCount == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        workerCount = cores > 0 ? (uint32_t)cores : 1;
+    }
+    size_t blocks = (batch->rowCount + BATCH_ROW_BLOCK - 1) / BATCH_ROW_BLOCK;
+    if (workerCount > blocks) {
+        workerCount = blocks > 0 ? (uint32_t)blocks : 1;
+    }
+
+    BatchRows rows;
+    rows.batch = batch;
+    rows.backend = backend;
+    atomic_init(&rows.next, 0);
+    atomic_init(&rows.failed, 0);
+
+    pthread_t* workers = ALLOCATE(MEM_COMPILER, pthread_t, workerCount);
+    uint32_t started = 0;
+    for (; started < workerCount; ++started) {
+        if (pthread_create(&workers[started], NULL, batchEvalWorker, &rows) != 0) {
+            break;
+        }
+    }
+    // no threads at all still makes progress on this one
+    if (started == 0) {
+        batchEvalWorker(&rows);
+    }
+    for (uint32_t i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    FREE_ARRAY(MEM_COMPILER, pthread_t, workers, workerCount);
+
+    return atomic_load(&rows.failed);
+}
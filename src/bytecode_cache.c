@@ -0,0 +1,298 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bytecode_cache.h"
+#include "chunk.h"
+#include "columns.h"
+#include "orion_memory.h"
+#include "value.h"
+
+_Static_assert(sizeof(OrcHeader) % 8 == 0, "OrcHeader must keep sections 8-byte aligned");
+
+#define ORC_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+// ORC_FLAG_* bits describing the Value layout this build uses
+uint32_t orcFlags(void) {
+#ifdef NAN_BOXING
+    return ORC_FLAG_NAN_BOXING;
+#else
+    return 0;
+#endif
+}
+
+// "dir/script.ori" -> "dir/script.orc", anything else gets ".orc" appended.
+// Release the path with freeString.
+char* bytecodePath(const char* sourcePath) {
+    size_t length = strlen(sourcePath);
+    if (length >= 4 && strcmp(sourcePath + length - 4, ".ori") == 0) {
+        char* path = copyString(sourcePath, length);
+        path[length - 1] = 'c';
+        return path;
+    }
+
+    char* path = ALLOCATE(MEM_STRINGS, char, length + 5);
+    memcpy(path, sourcePath, length);
+    memcpy(path + length, ".orc", 5);
+    return path;
+}
+
+static bool writePadded(FILE* file, const void* data, size_t size) {
+    static const uint8_t zeros[8] = {0};
+
+    if (size > 0 && fwrite(data, 1, size, file) != size) {
+        return false;
+    }
+
+    size_t padding = ORC_ALIGN(size) - size;
+    return fwrite(zeros, 1, padding, file) == padding;
+}
+
+// Writes the chunk to a temp file and renames it into place, so a process
+// mapping the old file never sees a half-written one. Best effort: on any
+// failure the cache is simply not updated.
+bool writeBytecodeFile(const char* path, Chunk* chunk, uint64_t sourceHash,
+                       size_t sourceLength) {
+    OrcHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ORC_MAGIC;
+    header.formatVersion = ORC_FORMAT_VERSION;
+    header.vmVersion = ORC_VM_VERSION;
+    header.valueSize = sizeof(Value);
+    header.flags = orcFlags();
+    header.sourceHash = sourceHash;
+    header.sourceLength = sourceLength;
+    header.constantCount = chunk->constants.count;
+    header.lineCount = (uint32_t)chunk->lineCount;
+    header.codeCount = (uint32_t)chunk->count;
+    header.maxStackDepth = (uint32_t)chunk->maxStackDepth;
+
+    size_t tempLength = strlen(path) + 32;
+    char* tempPath = ALLOCATE(MEM_STRINGS, char, tempLength);
+    snprintf(tempPath, tempLength, "%s.%ld.tmp", path, (long)getpid());
+
+    FILE* file = fopen(tempPath, "wb");
+    if (file == NULL) {
+        FREE_ARRAY(MEM_STRINGS, char, tempPath, tempLength);
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    // struct Values have padding, write them through a zeroed copy so the
+    // file contents are deterministic
+    for (uint32_t i = 0; ok && i < chunk->constants.count; ++i) {
+        Value constant;
+        memset(&constant, 0, sizeof(constant));
+#ifdef NAN_BOXING
+        constant = chunk->constants.data[i];
+#else
+        constant.type = chunk->constants.data[i].type;
+        constant.as = chunk->constants.data[i].as;
+#endif
+        ok = fwrite(&constant, sizeof(constant), 1, file) == 1;
+    }
+
+    ok = ok && writePadded(file, chunk->lines, sizeof(LineRun) * chunk->lineCount);
+    ok = ok && writePadded(file, chunk->data, chunk->count);
+    ok = (fclose(file) == 0) && ok;
+
+    if (ok) {
+        ok = rename(tempPath, path) == 0;
+    }
+    if (!ok) {
+        remove(tempPath);
+    }
+
+    FREE_ARRAY(MEM_STRINGS, char, tempPath, tempLength);
+    return ok;
+}
+
+static bool isJump(uint8_t opcode) {
+    return opcode == OP_JUMP || opcode == OP_JUMP_IF_FALSE || opcode == OP_JUMP_IF_TRUE;
+}
+
+// stack slots an instruction reads before its stackEffect applies
+static int32_t stackOperands(uint8_t opcode) {
+    if (opcode == OP_JUMP || stackEffect(opcode) > 0) {
+        return 0;
+    }
+    if (opcode == OP_RET || opcode == OP_POP || stackEffect(opcode) == 0) {
+        return 1;
+    }
+    return 2;
+}
+
+// run() and lowerToRegisters trust the code they are given: opcodes,
+// operands, jump targets and the stack depth. A file that went through
+// writeBytecodeFile keeps all of that, a truncated or edited one may not,
+// so the code is walked once the way computeMaxStackDepth does it: every
+// instruction is known and fits, constants are in the pool, no instruction
+// pops what isn't there, jumps land forward on an instruction and agree
+// with the fall-through on the depth there, and nothing runs past the end
+// or is unreachable. Returns the real maxStackDepth, or -1 when the code is
+// rejected.
+static int32_t verifyCode(Chunk* chunk) {
+    int32_t count = chunk->count;
+    // stack depth on arrival at each jump target, -1 for the rest
+    int32_t* targetDepth = ALLOCATE(MEM_COMPILER, int32_t, count + 1);
+    for (int32_t i = 0; i <= count; ++i) {
+        targetDepth[i] = -1;
+    }
+
+    int32_t depth = 0;
+    int32_t maxDepth = 0;
+    bool reachable = true;
+    bool valid = true;
+
+    for (int32_t offset = 0; valid && offset < count;) {
+        uint8_t opcode = chunk->data[offset];
+        const uint8_t* operand = chunk->data + offset + 1;
+        int32_t length = instructionLength(opcode);
+        if (opcode > OP_NOT_EQUAL_NUM || length > count - offset) {
+            valid = false;
+            break;
+        }
+        for (int32_t i = 1; i < length; ++i) {
+            valid = valid && targetDepth[offset + i] < 0;
+        }
+
+        if (targetDepth[offset] >= 0) {
+            valid = valid && (!reachable || depth == targetDepth[offset]);
+            depth = targetDepth[offset];
+            reachable = true;
+        }
+        valid = valid && reachable && depth >= stackOperands(opcode);
+
+        switch (opcode) {
+            case OP_CONSTANT:
+            case OP_ADD_CONST:
+            case OP_SUB_CONST:
+            case OP_MULT_CONST:
+            case OP_DIV_CONST:
+            case OP_GREATER_CONST:
+            case OP_LESS_CONST:
+            case OP_GREATER_EQUAL_CONST:
+            case OP_LESS_EQUAL_CONST:
+                valid = valid && operand[0] < chunk->constants.count;
+                break;
+            case OP_CONSTANT_LONG:
+                valid = valid && (uint32_t)((operand[0] << 16) | (operand[1] << 8) | operand[2])
+                                     < chunk->constants.count;
+                break;
+            case OP_GET_INPUT:
+                // cached chunks are scripts, they have no inputs to bind
+                valid = false;
+                break;
+            default:
+                break;
+        }
+
+        if (valid && isJump(opcode)) {
+            int32_t target = offset + 3 + ((operand[0] << 8) | operand[1]);
+            valid = target < count
+                    && (targetDepth[target] < 0 || targetDepth[target] == depth);
+            if (valid) {
+                targetDepth[target] = depth;
+            }
+        }
+
+        depth += stackEffect(opcode);
+        if (depth > maxDepth) {
+            maxDepth = depth;
+        }
+        reachable = opcode != OP_JUMP && opcode != OP_RET;
+        offset += length;
+    }
+
+    FREE_ARRAY(MEM_COMPILER, int32_t, targetDepth, count + 1);
+    // the last instruction has to leave run(), not fall off the code
+    return valid && !reachable ? maxDepth : -1;
+}
+
+// Maps path and builds a chunk over the mapped pages. Returns NULL when the
+// file is missing, was written by a different VM or Value layout, was
+// compiled from a different source or fails verifyCode.
+Chunk* loadBytecodeFile(const char* path, uint64_t sourceHash,
+                        size_t sourceLength) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(OrcHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    const OrcHeader* header = (const OrcHeader*)mapping;
+    size_t constantsSize = sizeof(Value) * header->constantCount;
+    size_t linesSize = ORC_ALIGN(sizeof(LineRun) * header->lineCount);
+    size_t codeSize = ORC_ALIGN(header->codeCount);
+
+    if (header->magic != ORC_MAGIC
+        || header->formatVersion != ORC_FORMAT_VERSION
+        || header->vmVersion != ORC_VM_VERSION
+        || header->valueSize != sizeof(Value)
+        || header->flags != orcFlags()
+        || header->sourceHash != sourceHash
+        || header->sourceLength != sourceLength
+        || header->constantCount > MAX_CONSTANTS
+        || header->codeCount == 0
+        || header->codeCount > INT32_MAX
+        || sizeof(OrcHeader) + constantsSize + linesSize + codeSize != size) {
+        munmap(mapping, size);
+        return NULL;
+    }
+
+    uint8_t* base = (uint8_t*)mapping;
+    uint8_t* constants = base + sizeof(OrcHeader);
+    uint8_t* lines = constants + constantsSize;
+    uint8_t* code = lines + linesSize;
+
+    Chunk* chunk = ALLOCATE(MEM_CHUNK, Chunk, 1);
+    chunk->constants.count = header->constantCount;
+    chunk->constants.capacity = header->constantCount;
+    chunk->constants.data = (Value*)constants;
+    chunk->constants.arena = NULL;
+    initValueTable(&chunk->constantIndex, NULL);
+    chunk->lines = (LineRun*)lines;
+    chunk->lineCount = (int32_t)header->lineCount;
+    chunk->lineCapacity = (int32_t)header->lineCount;
+    chunk->data = code;
+    chunk->count = (int32_t)header->codeCount;
+    chunk->capacity = (int32_t)header->codeCount;
+    chunk->inputCount = 0;
+    chunk->columnResult = COLUMNS_NONE;
+    chunk->registerCode = NULL;
+    chunk->mapping = mapping;
+    chunk->mappingSize = size;
+    chunk->arena = NULL;
+    initMemoryStats(&chunk->memory);
+
+    chunk->maxStackDepth = verifyCode(chunk);
+    if (chunk->maxStackDepth < 0) {
+        FREE(MEM_CHUNK, Chunk, chunk);
+        munmap(mapping, size);
+        return NULL;
+    }
+    return chunk;
+}
+
+void unmapBytecodeFile(void* mapping, size_t size) {
+    munmap(mapping, size);
+}
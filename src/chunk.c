@@ -1,29 +1,61 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "bytecode_cache.h"
 #include "chunk.h"
+#include "columns.h"
 #include "orion_memory.h"
+#include "register_vm.h"
 #include "value.h"
 
 void initChunk(Chunk* chunk) {
+    initMemoryStats(&chunk->memory);
+    MemoryStats* previous = useMemoryStats(&chunk->memory);
+    chunk->arena = ALLOCATE(MEM_CHUNK, Arena, 1);
+    useMemoryStats(previous);
+    initArena(chunk->arena, &chunk->memory);
     chunk->count = 0;
     chunk->capacity = DEFAULT_CHUNK_CAPACITY;
-    chunk->data = (uint8_t*)malloc(sizeof(uint8_t) * DEFAULT_CHUNK_CAPACITY);
-    chunk->lines = (int*)malloc(sizeof(int) * DEFAULT_CHUNK_CAPACITY);
-    initValueArr(&chunk->constants);
+    chunk->data =
+        ARENA_GROW_ARRAY(chunk->arena, MEM_CHUNK, uint8_t, NULL, 0, DEFAULT_CHUNK_CAPACITY);
+    chunk->lineCount = 0;
+    chunk->lineCapacity = DEFAULT_LINE_RUNS_CAPACITY;
+    chunk->lines =
+        ARENA_GROW_ARRAY(chunk->arena, MEM_CHUNK, LineRun, NULL, 0, DEFAULT_LINE_RUNS_CAPACITY);
+    initValueArr(&chunk->constants, chunk->arena);
+    initValueTable(&chunk->constantIndex, chunk->arena);
+    chunk->maxStackDepth = 0;
+    chunk->inputCount = 0;
+    chunk->columnResult = COLUMNS_NONE;
+    chunk->registerCode = NULL;
+    chunk->mapping = NULL;
+    chunk->mappingSize = 0;
 }
 
 void pushChunkEl(Chunk* chunk, uint8_t new_el, int* line_number,
                  bool should_increment_line) {
     if (chunk->count == chunk->capacity) {
         chunk->capacity *= 2;
-        chunk->data = GROW_ARRAY(uint8_t, chunk->data, chunk->capacity);
-        chunk->lines = GROW_ARRAY(int, chunk->lines, chunk->capacity);
+        chunk->data = ARENA_GROW_ARRAY(chunk->arena, MEM_CHUNK, uint8_t, chunk->data,
+                                       chunk->capacity / 2, chunk->capacity);
     }
 
     chunk->data[chunk->count] = new_el;
-    chunk->lines[chunk->count] = *line_number;
     chunk->count++;
+
+    if (chunk->lineCount > 0 && chunk->lines[chunk->lineCount - 1].line == *line_number) {
+        chunk->lines[chunk->lineCount - 1].count++;
+    } else {
+        if (chunk->lineCount == chunk->lineCapacity) {
+            chunk->lineCapacity *= 2;
+            chunk->lines = ARENA_GROW_ARRAY(chunk->arena, MEM_CHUNK, LineRun, chunk->lines,
+                                            chunk->lineCapacity / 2, chunk->lineCapacity);
+        }
+        chunk->lines[chunk->lineCount] = (LineRun){*line_number, 1};
+        chunk->lineCount++;
+    }
+
     if (should_increment_line) {
         (*line_number)++;
     }
@@ -36,36 +68,228 @@ uint8_t popChunkEl(Chunk* chunk) {
 
     int popped_el = chunk->data[chunk->count - 1];
     chunk->data[chunk->count - 1] = 0;
-    chunk->lines[chunk->count - 1] = -1;
     chunk->count--;
 
+    LineRun* last = &chunk->lines[chunk->lineCount - 1];
+    last->count--;
+    if (last->count == 0) {
+        chunk->lineCount--;
+    }
+
     return popped_el;
 }
 
+int32_t getLine(Chunk* chunk, int offset) {
+    for (int32_t i = 0; i < chunk->lineCount; ++i) {
+        offset -= chunk->lines[i].count;
+        if (offset < 0) {
+            return chunk->lines[i].line;
+        }
+    }
+
+    return -1;
+}
+
+// opcode plus operand bytes
+int instructionLength(uint8_t opcode) {
+    switch (opcode) {
+        case OP_CONSTANT:
+        case OP_PUSH_I8:
+        case OP_GET_INPUT:
+        case OP_ADD_CONST:
+        case OP_SUB_CONST:
+        case OP_MULT_CONST:
+        case OP_DIV_CONST:
+        case OP_GREATER_CONST:
+        case OP_LESS_CONST:
+        case OP_GREATER_EQUAL_CONST:
+        case OP_LESS_EQUAL_CONST:
+        case OP_ADD_IMM:
+        case OP_SUB_IMM:
+        case OP_MULT_IMM:
+        case OP_DIV_IMM:
+        case OP_GREATER_IMM:
+        case OP_LESS_IMM:
+        case OP_GREATER_EQUAL_IMM:
+        case OP_LESS_EQUAL_IMM:
+            return 2;
+        case OP_PUSH_I16:
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+            return 3;
+        case OP_CONSTANT_LONG:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+// values pushed minus values popped
+int stackEffect(uint8_t opcode) {
+    switch (opcode) {
+        case OP_NIL:
+        case OP_CONSTANT:
+        case OP_CONSTANT_LONG:
+        case OP_ZERO:
+        case OP_ONE:
+        case OP_PUSH_I8:
+        case OP_PUSH_I16:
+        case OP_GET_INPUT:
+        case OP_TRUE:
+        case OP_FALSE:
+            return 1;
+        case OP_RET:
+        case OP_POP:
+        case OP_XOR:
+        case OP_EQUAL:
+        case OP_NOT_EQUAL:
+        case OP_GREATER:
+        case OP_LESS:
+        case OP_GREATER_EQUAL:
+        case OP_LESS_EQUAL:
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MULT:
+        case OP_DIV:
+        case OP_ADD_NUM:
+        case OP_SUB_NUM:
+        case OP_MULT_NUM:
+        case OP_DIV_NUM:
+        case OP_GREATER_NUM:
+        case OP_LESS_NUM:
+        case OP_GREATER_EQUAL_NUM:
+        case OP_LESS_EQUAL_NUM:
+        case OP_EQUAL_NUM:
+        case OP_NOT_EQUAL_NUM:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+// Jumps only go forward and the conditional ones peek instead of popping,
+// so one pass carries the depth at every jump to its target. The depth at
+// an instruction is the largest of its fall-through and incoming jumps.
+int32_t computeMaxStackDepth(Chunk* chunk) {
+    int32_t* incoming = ALLOCATE(MEM_COMPILER, int32_t, chunk->count + 1);
+    memset(incoming, 0, sizeof(int32_t) * (chunk->count + 1));
+    int32_t depth = 0;
+    int32_t maxDepth = 0;
+
+    for (int offset = 0; offset < chunk->count;) {
+        uint8_t opcode = chunk->data[offset];
+        if (incoming[offset] > depth) {
+            depth = incoming[offset];
+        }
+
+        if (opcode == OP_JUMP || opcode == OP_JUMP_IF_FALSE || opcode == OP_JUMP_IF_TRUE) {
+            uint16_t jump = (uint16_t)((chunk->data[offset + 1] << 8) | chunk->data[offset + 2]);
+            int target = offset + 3 + jump;
+            if (target <= chunk->count && incoming[target] < depth) {
+                incoming[target] = depth;
+            }
+        }
+
+        depth += stackEffect(opcode);
+        if (depth > maxDepth) {
+            maxDepth = depth;
+        }
+        offset += instructionLength(opcode);
+    }
+
+    FREE_ARRAY(MEM_COMPILER, int32_t, incoming, chunk->count + 1);
+    return maxDepth;
+}
+
+// heap (or mapped) bytes held by the chunk, its register form included
+size_t chunkFootprint(Chunk* chunk) {
+    size_t bytes = sizeof(Chunk);
+    if (chunk->mapping != NULL) {
+        bytes += chunk->mappingSize;
+    } else if (chunk->arena != NULL) {
+        bytes += sizeof(Arena) + chunk->arena->reserved;
+    }
+
+    RegisterChunk* code = chunk->registerCode;
+    if (code != NULL) {
+        bytes += sizeof(RegisterChunk)
+               + (sizeof(RegisterInstruction) + sizeof(int32_t)) * (size_t)code->capacity
+               + sizeof(Value) * code->immediates.capacity;
+    }
+
+    return bytes;
+}
+
+MemoryStats* chunkMemoryStats(Chunk* chunk) {
+    return &chunk->memory;
+}
+
 void freeChunk(Chunk* chunk) {
-    if (chunk->data != NULL) {
-        free(chunk->data);
-        free(chunk->lines);
-        freeValueArr(&chunk->constants);
+    MemoryStats* previous = useMemoryStats(&chunk->memory);
+    if (chunk->registerCode != NULL) {
+        freeRegisterChunk(chunk->registerCode);
+        chunk->registerCode = NULL;
+    }
+
+    if (chunk->mapping != NULL) {
+        unmapBytecodeFile(chunk->mapping, chunk->mappingSize);
+        chunk->mapping = NULL;
         chunk->data = NULL;
         chunk->lines = NULL;
+        chunk->constants.data = NULL;
+    } else if (chunk->arena != NULL) {
+        freeArena(chunk->arena);
+        FREE(MEM_CHUNK, Arena, chunk->arena);
+        chunk->arena = NULL;
+        chunk->data = NULL;
+        chunk->lines = NULL;
+        chunk->constants.data = NULL;
+        initValueTable(&chunk->constantIndex, NULL);
     }
+    useMemoryStats(previous);
 }
 
-void pushConstantToChunk(Chunk* chunk, Value constant, int* lineNumber) {
-    if (isValueArrFull(&chunk->constants)) {
-        fprintf(stderr, "Too many constants in one chunk\n");
-        return;
+// returns the slot holding constant, reusing an identical one if present,
+// -1 once the pool is exhausted
+int addConstantToChunk(Chunk* chunk, Value constant) {
+    int32_t existing = valueTableGet(&chunk->constantIndex, constant);
+    if (existing >= 0) {
+        return existing;
+    }
+
+    if (chunk->constants.count == MAX_CONSTANTS) {
+        return -1;
     }
 
     pushValueArrEl(&chunk->constants, constant);
+    int index = (int)chunk->constants.count - 1;
+    valueTableSet(&chunk->constantIndex, constant, index);
+    return index;
+}
+
+// emits the short form while the index fits in a byte, OP_CONSTANT_LONG after
+bool pushConstantToChunk(Chunk* chunk, Value constant, int* lineNumber) {
+    int index = addConstantToChunk(chunk, constant);
+    if (index < 0) {
+        return false;
+    }
+
+    if (index <= UINT8_MAX) {
+        pushChunkEl(chunk, OP_CONSTANT, lineNumber, false);
+        pushChunkEl(chunk, (uint8_t)index, lineNumber, false);
+    } else {
+        pushChunkEl(chunk, OP_CONSTANT_LONG, lineNumber, false);
+        pushChunkEl(chunk, (uint8_t)((index >> 16) & 0xff), lineNumber, false);
+        pushChunkEl(chunk, (uint8_t)((index >> 8) & 0xff), lineNumber, false);
+        pushChunkEl(chunk, (uint8_t)(index & 0xff), lineNumber, false);
+    }
 
-    uint8_t index = chunk->constants.count - 1;
-    pushChunkEl(chunk, OP_CONSTANT, lineNumber, false);
-    pushChunkEl(chunk, index, lineNumber, false);
+    return true;
 }
 
 Value popConstantFromChunk(Chunk* chunk) {
-  Value popped_val = popValueArrEl(&chunk->constants);
+    Value popped_val = popValueArrEl(&chunk->constants);
+    valueTableDelete(&chunk->constantIndex, popped_val);
     return popped_val;
 }
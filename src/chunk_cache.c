@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk_cache.h"
+#include "orion_memory.h"
+#include "vm.h"
+
+void initChunkCache(ChunkCache* cache) {
+    cache->count = 0;
+    cache->capacity = 0;
+    cache->entries = NULL;
+}
+
+void freeChunkCache(ChunkCache* cache) {
+    for (uint32_t i = 0; i < cache->capacity; ++i) {
+        ChunkCacheEntry* entry = &cache->entries[i];
+        if (entry->chunk != NULL) {
+            releaseChunk(entry->chunk);
+            FREE_ARRAY(MEM_STRINGS, char, entry->source, entry->length + 1);
+        }
+    }
+
+    FREE_ARRAY(MEM_CACHE, ChunkCacheEntry, cache->entries, cache->capacity);
+    initChunkCache(cache);
+}
+
+// FNV-1a
+uint64_t hashSource(const char* source, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (uint8_t)source[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static ChunkCacheEntry* findChunkCacheEntry(ChunkCacheEntry* entries,
+                                            uint32_t capacity, uint64_t hash,
+                                            const char* source, size_t length) {
+    uint32_t slot = (uint32_t)hash & (capacity - 1);
+
+    for (;;) {
+        ChunkCacheEntry* entry = &entries[slot];
+        if (entry->chunk == NULL) {
+            return entry;
+        }
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(entry->source, source, length) == 0) {
+            return entry;
+        }
+
+        slot = (slot + 1) & (capacity - 1);
+    }
+}
+
+static void growChunkCache(ChunkCache* cache) {
+    uint32_t capacity = cache->capacity == 0 ? 16 : cache->capacity * 2;
+    ChunkCacheEntry* entries = ALLOCATE(MEM_CACHE, ChunkCacheEntry, capacity);
+    memset(entries, 0, sizeof(ChunkCacheEntry) * capacity);
+
+    for (uint32_t i = 0; i < cache->capacity; ++i) {
+        ChunkCacheEntry* entry = &cache->entries[i];
+        if (entry->chunk == NULL) {
+            continue;
+        }
+
+        *findChunkCacheEntry(entries, capacity, entry->hash, entry->source,
+                             entry->length) = *entry;
+    }
+
+    FREE_ARRAY(MEM_CACHE, ChunkCacheEntry, cache->entries, cache->capacity);
+    cache->entries = entries;
+    cache->capacity = capacity;
+}
+
+// Returns the chunk compiled from source, compiling it on the first call.
+// The cache owns the chunk. Sources that fail to compile are not cached and
+// yield NULL.
+Chunk* getCachedChunk(ChunkCache* cache, const char* source) {
+    size_t length = strlen(source);
+    uint64_t hash = hashSource(source, length);
+
+    if (cache->count + 1 > cache->capacity * CHUNK_CACHE_MAX_LOAD) {
+        growChunkCache(cache);
+    }
+
+    ChunkCacheEntry* entry = findChunkCacheEntry(cache->entries, cache->capacity,
+                                                 hash, source, length);
+    if (entry->chunk != NULL) {
+        return entry->chunk;
+    }
+
+    Chunk* chunk = compileChunk(source);
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    entry->hash = hash;
+    entry->length = length;
+    entry->source = copyString(source, length);
+    entry->chunk = chunk;
+    cache->count++;
+
+    return chunk;
+}
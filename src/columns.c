@@ -0,0 +1,309 @@
+#include <stdint.h>
+
+#include "chunk.h"
+#include "columns.h"
+#include "value.h"
+
+// Bools live in the columns as 1.0 and 0.0, so the logic operators can
+// test against zero the way isFalseyValue does for numbers.
+typedef enum {
+    SLOT_NUMBER,
+    SLOT_BOOL
+} SlotType;
+
+// operator an opcode applies, whichever form it was emitted or quickened in
+static uint8_t baseOperator(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD_NUM:
+        case OP_ADD_CONST:
+        case OP_ADD_IMM: return OP_ADD;
+        case OP_SUB_NUM:
+        case OP_SUB_CONST:
+        case OP_SUB_IMM: return OP_SUB;
+        case OP_MULT_NUM:
+        case OP_MULT_CONST:
+        case OP_MULT_IMM: return OP_MULT;
+        case OP_DIV_NUM:
+        case OP_DIV_CONST:
+        case OP_DIV_IMM: return OP_DIV;
+        case OP_GREATER_NUM:
+        case OP_GREATER_CONST:
+        case OP_GREATER_IMM: return OP_GREATER;
+        case OP_LESS_NUM:
+        case OP_LESS_CONST:
+        case OP_LESS_IMM: return OP_LESS;
+        case OP_GREATER_EQUAL_NUM:
+        case OP_GREATER_EQUAL_CONST:
+        case OP_GREATER_EQUAL_IMM: return OP_GREATER_EQUAL;
+        case OP_LESS_EQUAL_NUM:
+        case OP_LESS_EQUAL_CONST:
+        case OP_LESS_EQUAL_IMM: return OP_LESS_EQUAL;
+        case OP_EQUAL_NUM: return OP_EQUAL;
+        case OP_NOT_EQUAL_NUM: return OP_NOT_EQUAL;
+        default: return opcode;
+    }
+}
+
+static bool isConstantForm(uint8_t opcode) {
+    return opcode >= OP_ADD_CONST && opcode <= OP_LESS_EQUAL_CONST;
+}
+
+static bool isImmediateForm(uint8_t opcode) {
+    return opcode >= OP_ADD_IMM && opcode <= OP_LESS_EQUAL_IMM;
+}
+
+static bool isArithmetic(uint8_t op) {
+    return op == OP_ADD || op == OP_SUB || op == OP_MULT || op == OP_DIV;
+}
+
+static bool isComparison(uint8_t op) {
+    return op == OP_GREATER || op == OP_LESS || op == OP_GREATER_EQUAL || op == OP_LESS_EQUAL;
+}
+
+static uint32_t constantIndex(Chunk* chunk, int offset) {
+    uint8_t* operand = chunk->data + offset + 1;
+    if (chunk->data[offset] == OP_CONSTANT_LONG) {
+        return (uint32_t)((operand[0] << 16) | (operand[1] << 8) | operand[2]);
+    }
+    return operand[0];
+}
+
+// Runs the code over a stack of slot types. Every operator has to see
+// the types it can't fail on: numbers for arithmetic and ordering, the
+// same type on both sides of ==, anything for the logic operators.
+ColumnResult analyzeColumns(Chunk* chunk) {
+    if (chunk->maxStackDepth > COLUMN_MAX_DEPTH) {
+        return COLUMNS_NONE;
+    }
+
+    SlotType slots[COLUMN_MAX_DEPTH + 1];
+    int depth = 0;
+
+    for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk->data[offset])) {
+        uint8_t opcode = chunk->data[offset];
+        uint8_t op = baseOperator(opcode);
+
+        switch (op) {
+            case OP_CONSTANT:
+            case OP_CONSTANT_LONG:
+                if (!IS_NUMBER(chunk->constants.data[constantIndex(chunk, offset)])) {
+                    return COLUMNS_NONE;
+                }
+                slots[depth++] = SLOT_NUMBER;
+                continue;
+            case OP_ZERO:
+            case OP_ONE:
+            case OP_PUSH_I8:
+            case OP_PUSH_I16:
+            case OP_GET_INPUT:
+                slots[depth++] = SLOT_NUMBER;
+                continue;
+            case OP_TRUE:
+            case OP_FALSE:
+                slots[depth++] = SLOT_BOOL;
+                continue;
+            case OP_NEGATE:
+            case OP_INC:
+            case OP_DEC:
+                if (slots[depth - 1] != SLOT_NUMBER) {
+                    return COLUMNS_NONE;
+                }
+                continue;
+            case OP_NOT:
+            case OP_TO_BOOL:
+                slots[depth - 1] = SLOT_BOOL;
+                continue;
+            case OP_XOR:
+                depth--;
+                slots[depth - 1] = SLOT_BOOL;
+                continue;
+            case OP_EQUAL:
+            case OP_NOT_EQUAL:
+                depth--;
+                if (slots[depth - 1] != slots[depth]) {
+                    return COLUMNS_NONE;
+                }
+                slots[depth - 1] = SLOT_BOOL;
+                continue;
+            case OP_RET:
+                // the compiler ends every chunk with its only OP_RET
+                return slots[depth - 1] == SLOT_BOOL ? COLUMNS_BOOL : COLUMNS_NUMBER;
+            default:
+                break;
+        }
+
+        if (!isArithmetic(op) && !isComparison(op)) {
+            // jumps, pops and nil
+            return COLUMNS_NONE;
+        }
+        if (isConstantForm(opcode)) {
+            if (slots[depth - 1] != SLOT_NUMBER
+                || !IS_NUMBER(chunk->constants.data[constantIndex(chunk, offset)])) {
+                return COLUMNS_NONE;
+            }
+        } else if (isImmediateForm(opcode)) {
+            if (slots[depth - 1] != SLOT_NUMBER) {
+                return COLUMNS_NONE;
+            }
+        } else {
+            depth--;
+            if (slots[depth - 1] != SLOT_NUMBER || slots[depth] != SLOT_NUMBER) {
+                return COLUMNS_NONE;
+            }
+        }
+        slots[depth - 1] = isComparison(op) ? SLOT_BOOL : SLOT_NUMBER;
+    }
+
+    return COLUMNS_NONE;
+}
+
+// The kernels: one loop per operator, with the switch outside it.
+#define COLUMN_LOOP(expression)             \
+    do {                                    \
+        for (int i = 0; i < n; ++i) {       \
+            a[i] = (expression);            \
+        }                                   \
+    } while (false)
+
+static void fillColumn(double* restrict a, int n, double value) {
+    COLUMN_LOOP(value);
+}
+
+static void unaryColumn(uint8_t op, double* restrict a, int n) {
+    switch (op) {
+        case OP_NEGATE: COLUMN_LOOP(-a[i]); break;
+        case OP_INC: COLUMN_LOOP(a[i] + 1); break;
+        case OP_DEC: COLUMN_LOOP(a[i] - 1); break;
+        case OP_NOT: COLUMN_LOOP((double)(a[i] == 0)); break;
+        case OP_TO_BOOL: COLUMN_LOOP((double)(a[i] != 0)); break;
+        default: break;
+    }
+}
+
+static void binaryColumns(uint8_t op, double* restrict a, const double* restrict b, int n) {
+    switch (op) {
+        case OP_ADD: COLUMN_LOOP(a[i] + b[i]); break;
+        case OP_SUB: COLUMN_LOOP(a[i] - b[i]); break;
+        case OP_MULT: COLUMN_LOOP(a[i] * b[i]); break;
+        case OP_DIV: COLUMN_LOOP(a[i] / b[i]); break;
+        case OP_GREATER: COLUMN_LOOP((double)(a[i] > b[i])); break;
+        case OP_LESS: COLUMN_LOOP((double)(a[i] < b[i])); break;
+        case OP_GREATER_EQUAL: COLUMN_LOOP((double)(a[i] >= b[i])); break;
+        case OP_LESS_EQUAL: COLUMN_LOOP((double)(a[i] <= b[i])); break;
+        case OP_EQUAL: COLUMN_LOOP((double)(a[i] == b[i])); break;
+        case OP_NOT_EQUAL: COLUMN_LOOP((double)(a[i] != b[i])); break;
+        case OP_XOR: COLUMN_LOOP((double)((a[i] != 0) != (b[i] != 0))); break;
+        default: break;
+    }
+}
+
+static void constantColumn(uint8_t op, double* restrict a, double k, int n) {
+    switch (op) {
+        case OP_ADD: COLUMN_LOOP(a[i] + k); break;
+        case OP_SUB: COLUMN_LOOP(a[i] - k); break;
+        case OP_MULT: COLUMN_LOOP(a[i] * k); break;
+        case OP_DIV: COLUMN_LOOP(a[i] / k); break;
+        case OP_GREATER: COLUMN_LOOP((double)(a[i] > k)); break;
+        case OP_LESS: COLUMN_LOOP((double)(a[i] < k)); break;
+        case OP_GREATER_EQUAL: COLUMN_LOOP((double)(a[i] >= k)); break;
+        case OP_LESS_EQUAL: COLUMN_LOOP((double)(a[i] <= k)); break;
+        default: break;
+    }
+}
+
+#undef COLUMN_LOOP
+
+// Runs a chunk analyzeColumns accepted over rowCount (at most COLUMN_WIDTH)
+// rows of inputs, laid out as in EvalBatch. columns is the scratch for the
+// stack, chunk->maxStackDepth columns of COLUMN_WIDTH doubles. The types
+// were proven up front except for the inputs': returns false, with results
+// untouched, when one isn't a number, and the rows then have to run one by
+// one to raise their errors.
+bool runColumns(Chunk* chunk, const Value* inputs, size_t rowCount, Value* results,
+                double* columns) {
+    int n = (int)rowCount;
+    size_t width = (size_t)chunk->inputCount;
+    const Value* constants = chunk->constants.data;
+    // the next free column
+    double* top = columns;
+
+    for (uint8_t* ip = chunk->data;;) {
+        uint8_t opcode = *ip++;
+        uint8_t op = baseOperator(opcode);
+
+        switch (op) {
+            case OP_GET_INPUT: {
+                const Value* input = inputs + *ip++;
+                bool numbers = true;
+                for (int i = 0; i < n; ++i) {
+                    Value value = input[i * width];
+                    numbers &= IS_NUMBER(value);
+                    top[i] = AS_NUMBER(value);
+                }
+                if (!numbers) {
+                    return false;
+                }
+                top += COLUMN_WIDTH;
+                break;
+            }
+            case OP_CONSTANT:
+                fillColumn(top, n, AS_NUMBER(constants[*ip++]));
+                top += COLUMN_WIDTH;
+                break;
+            case OP_CONSTANT_LONG:
+                fillColumn(top, n, AS_NUMBER(constants[(ip[0] << 16) | (ip[1] << 8) | ip[2]]));
+                ip += 3;
+                top += COLUMN_WIDTH;
+                break;
+            case OP_ZERO:
+            case OP_FALSE:
+                fillColumn(top, n, 0);
+                top += COLUMN_WIDTH;
+                break;
+            case OP_ONE:
+            case OP_TRUE:
+                fillColumn(top, n, 1);
+                top += COLUMN_WIDTH;
+                break;
+            case OP_PUSH_I8:
+                fillColumn(top, n, (int8_t)*ip++);
+                top += COLUMN_WIDTH;
+                break;
+            case OP_PUSH_I16:
+                fillColumn(top, n, (int16_t)((ip[0] << 8) | ip[1]));
+                ip += 2;
+                top += COLUMN_WIDTH;
+                break;
+            case OP_NEGATE:
+            case OP_INC:
+            case OP_DEC:
+            case OP_NOT:
+            case OP_TO_BOOL:
+                unaryColumn(op, top - COLUMN_WIDTH, n);
+                break;
+            case OP_RET: {
+                const double* a = top - COLUMN_WIDTH;
+                if (chunk->columnResult == COLUMNS_BOOL) {
+                    for (int i = 0; i < n; ++i) {
+                        results[i] = BOOL_VAL(a[i] != 0);
+                    }
+                } else {
+                    for (int i = 0; i < n; ++i) {
+                        results[i] = NUMBER_VAL(a[i]);
+                    }
+                }
+                return true;
+            }
+            default:
+                if (isConstantForm(opcode)) {
+                    constantColumn(op, top - COLUMN_WIDTH, AS_NUMBER(constants[*ip++]), n);
+                } else if (isImmediateForm(opcode)) {
+                    constantColumn(op, top - COLUMN_WIDTH, (int8_t)*ip++, n);
+                } else {
+                    top -= COLUMN_WIDTH;
+                    binaryColumns(op, top - COLUMN_WIDTH, top, n);
+                }
+                break;
+        }
+    }
+}
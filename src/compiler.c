@@ -1,16 +1,17 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <math.h>
 
 #include "chunk.h"
+#include "columns.h"
 #include "compiler.h"
 #include "scanner.h"
 #include "debug.h"
+#include "peephole.h"
 #include "value.h"
 
-Parser parser;
-Chunk* currentChunk;
-
 ParseRule rules[] = {
     [TOKEN_LEFT_PAREN]    = {grouping, NULL,   PREC_NONE},
     [TOKEN_RIGHT_PAREN]   = {NULL,     NULL,   PREC_NONE},
@@ -31,10 +32,10 @@ ParseRule rules[] = {
     [TOKEN_GREATER_EQUAL] = {NULL,     binary, PREC_COMPARISON},
     [TOKEN_LESS]          = {NULL,     binary, PREC_COMPARISON},
     [TOKEN_LESS_EQUAL]    = {NULL,     binary, PREC_COMPARISON},
-    [TOKEN_IDENTIFIER]    = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_IDENTIFIER]    = {input,    NULL,   PREC_NONE},
     [TOKEN_STRING]        = {NULL,     NULL,   PREC_NONE},
     [TOKEN_NUMBER]        = {number,   NULL,   PREC_NONE},
-    [TOKEN_AND]           = {NULL,     binary, PREC_AND},
+    [TOKEN_AND]           = {NULL,     and_,   PREC_AND},
     [TOKEN_CLASS]         = {NULL,     NULL,   PREC_NONE},
     [TOKEN_ELSE]          = {NULL,     NULL,   PREC_NONE},
     [TOKEN_FALSE]         = {literal,  NULL,   PREC_NONE},
@@ -42,7 +43,7 @@ ParseRule rules[] = {
     [TOKEN_FUN]           = {NULL,     NULL,   PREC_NONE},
     [TOKEN_IF]            = {NULL,     NULL,   PREC_NONE},
     [TOKEN_NIL]           = {literal,  NULL,   PREC_NONE},
-    [TOKEN_OR]            = {NULL,     binary, PREC_OR},
+    [TOKEN_OR]            = {NULL,     or_,    PREC_OR},
     [TOKEN_XOR]           = {NULL,     binary, PREC_OR},
     [TOKEN_PRINT]         = {NULL,     NULL,   PREC_NONE},
     [TOKEN_RETURN]        = {NULL,     NULL,   PREC_NONE},
@@ -56,195 +57,582 @@ ParseRule rules[] = {
 };
 
 bool compile(const char* source, Chunk* chunk) {
-    initScanner(source);
-    currentChunk = chunk;
+    return compileWithDiagnostics(source, chunk, stderr);
+}
+
+// Everything a compilation touches hangs off the Parser on this stack
+// frame, so it can run on several threads at once. Compile errors are
+// written to diagnostics.
+bool compileWithDiagnostics(const char* source, Chunk* chunk, FILE* diagnostics) {
+    Parser parser;
+    initParser(&parser, source, chunk);
+    parser.diagnostics = diagnostics;
+
+#ifdef PRELEX
+    TokenBuffer tokens;
+    initTokenBuffer(&tokens);
+    if (strlen(source) <= TOKEN_BUFFER_MAX_SOURCE) {
+        lexTokens(&tokens, source);
+        useTokenBuffer(&parser, &tokens);
+    }
+
+    bool compiled = compileParser(&parser);
+    freeTokenBuffer(&tokens);
+    return compiled;
+#else
+    return compileParser(&parser);
+#endif
+}
+
+void useTokenBuffer(Parser* parser, TokenBuffer* tokens) {
+    parser->tokens = tokens;
+    initTokenCursor(&parser->cursor, tokens);
+}
+
+// One pass straight from fd: the source is never held in full, only a
+// window of about windowSize bytes, see SourceStream.
+bool compileStream(int fd, size_t windowSize, Chunk* chunk, FILE* diagnostics) {
+    Parser parser;
+    SourceStream stream;
+    initParser(&parser, "", chunk);
+    initStreamScanner(&parser.scanner, &stream, fd, windowSize);
+    parser.diagnostics = diagnostics;
+
+    bool compiled = compileParser(&parser);
+    if (stream.failed) {
+        fprintf(diagnostics, "Could not read the source stream.\n");
+        compiled = false;
+    }
+    freeSourceStream(&stream);
+    return compiled;
+}
 
-    initParser();
-    advanceParser();
-    expression();
+// The scanner runs on a second thread, a block of tokens ahead of the
+// parser. Falls back to compiling on this thread alone when it can't.
+bool compilePipelined(const char* source, Chunk* chunk, FILE* diagnostics) {
+    TokenRing ring;
+    if (!startTokenRing(&ring, source)) {
+        return compileWithDiagnostics(source, chunk, diagnostics);
+    }
 
-    consume(TOKEN_EOF, "Expect end of expression");
-    endCompiler();
+    Parser parser;
+    initParser(&parser, source, chunk);
+    parser.diagnostics = diagnostics;
+    parser.ring = &ring;
 
-    return !parser.hadError;
+    bool compiled = compileParser(&parser);
+    stopTokenRing(&ring);
+    return compiled;
 }
 
-void advanceParser() {
-    parser.prev = parser.curr;
+// An expression over named inputs, to be run once per row of a batch (see
+// batch_eval.h). Every identifier has to be one of the names. The finished
+// chunk is also checked for whether it can run as columns, see columns.h.
+bool compileWithInputs(const char* source, Chunk* chunk, const char* const* names,
+                       int32_t nameCount, FILE* diagnostics) {
+    if (nameCount > UINT8_MAX + 1) {
+        fprintf(diagnostics, "Too many inputs in one chunk.\n");
+        return false;
+    }
+
+    Parser parser;
+    initParser(&parser, source, chunk);
+    parser.diagnostics = diagnostics;
+    parser.inputNames = names;
+    parser.inputCount = nameCount;
+    chunk->inputCount = nameCount;
+
+    if (!compileParser(&parser)) {
+        return false;
+    }
+    chunk->columnResult = (uint8_t)analyzeColumns(chunk);
+    return true;
+}
+
+bool compileParser(Parser* parser) {
+    advanceParser(parser);
+    expression(parser);
+
+    consume(parser, TOKEN_EOF, "Expect end of expression");
+    endCompiler(parser);
+
+    return !parser->hadError;
+}
+
+void advanceParser(Parser* parser) {
+    parser->prev = parser->curr;
+    parser->prevNumber = parser->currNumber;
 
     for (;;) {
-        parser.curr = scanToken();
-        if (parser.curr.type != TOKEN_ERROR) {
+        if (parser->tokens != NULL) {
+            parser->curr = readToken(parser->tokens, &parser->cursor);
+        } else if (parser->ring != NULL) {
+            parser->curr = readRingToken(parser->ring, &parser->currNumber);
+        } else {
+            parser->curr = scanToken(&parser->scanner);
+        }
+        if (parser->curr.type != TOKEN_ERROR) {
             break;
         }
 
-        errorAt(&parser.curr, parser.curr.start);
+        errorAt(parser, &parser->curr, parser->curr.start);
     }
 }
 
-void consume(TokenType tokenType, const char* message) {
-    if (parser.curr.type == tokenType) {
-        advanceParser();
+void consume(Parser* parser, TokenType tokenType, const char* message) {
+    if (parser->curr.type == tokenType) {
+        advanceParser(parser);
         return;
     }
 
-    errorAt(&parser.curr, message);
+    errorAt(parser, &parser->curr, message);
 }
 
-void number() {
-    double value = strtod(parser.prev.start, NULL);
-    emitConstant(NUMBER_VAL(value));
+void number(Parser* parser) {
+    double value =
+        parser->ring != NULL ? parser->prevNumber : strtod(parser->prev.start, NULL);
+    emitNumber(parser, value);
 }
 
-void literal() {
-    switch (parser.prev.type) {
-        case TOKEN_TRUE: emitByte(OP_TRUE); break;
-        case TOKEN_FALSE: emitByte(OP_FALSE); break;
-        case TOKEN_NIL: emitByte(OP_NIL); break;
+void literal(Parser* parser) {
+    switch (parser->prev.type) {
+        case TOKEN_TRUE: emitByte(parser, OP_TRUE); break;
+        case TOKEN_FALSE: emitByte(parser, OP_FALSE); break;
+        case TOKEN_NIL: emitByte(parser, OP_NIL); break;
         default:
             assert(true && "Unrecognized literal presented.");
     }
 }
 
-void grouping() {
-    expression();
-    consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+void input(Parser* parser) {
+    int length = tokenLength(&parser->prev);
+    for (int32_t i = 0; i < parser->inputCount; ++i) {
+        const char* name = parser->inputNames[i];
+        if ((int)strlen(name) == length && memcmp(name, parser->prev.start, length) == 0) {
+            emitBytes(parser, OP_GET_INPUT, (uint8_t)i);
+            return;
+        }
+    }
+
+    // a script without inputs has no use for names at all
+    errorAt(parser, &parser->prev,
+            parser->inputCount == 0 ? "Expected expression." : "Undefined input.");
 }
 
-void unary() {
-    TokenType operatorType = parser.prev.type;
+void grouping(Parser* parser) {
+    expression(parser);
+    consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+}
+
+void unary(Parser* parser) {
+    TokenType operatorType = parser->prev.type;
+    OperandMark operand = markOperand(parser);
+
+    parsePrecedence(parser, PREC_UNARY);
 
-    parsePrecedence(PREC_UNARY);
+    if (tryFoldUnary(parser, operatorType, operand)) {
+        return;
+    }
 
     switch (operatorType) {
         case TOKEN_MINUS:
-            emitByte(OP_NEGATE);
+            emitByte(parser, OP_NEGATE);
             break;
         case TOKEN_BANG:
-            emitByte(OP_NOT);
+            emitByte(parser, OP_NOT);
             break;
         default:
             return;
     }
 }
 
-void binary() {
-    TokenType operatorType = parser.prev.type;
+void binary(Parser* parser) {
+    TokenType operatorType = parser->prev.type;
+    OperandMark lhs = parser->lhsMark;
+    OperandMark rhs = markOperand(parser);
     ParseRule* rule = getRule(operatorType);
-    parsePrecedence((Precedence)(rule->precedence + 1));
+    parsePrecedence(parser, (Precedence)(rule->precedence + 1));
+
+    if (tryFoldBinary(parser, operatorType, lhs, rhs.codeStart, rhs.codeStart)) {
+        return;
+    }
 
     switch (operatorType) {
         case TOKEN_PLUS:
-            emitByte(OP_ADD);
+            emitByte(parser, OP_ADD);
             break;
         case TOKEN_MINUS:
-            emitByte(OP_SUB);
+            emitByte(parser, OP_SUB);
             break;
         case TOKEN_STAR:
-            emitByte(OP_MULT);
+            emitByte(parser, OP_MULT);
             break;
         case TOKEN_SLASH:
-            emitByte(OP_DIV);
-            break;
-        case TOKEN_AND:
-            emitByte(OP_AND);
-            break;
-        case TOKEN_OR:
-            emitByte(OP_OR);
+            emitByte(parser, OP_DIV);
             break;
         case TOKEN_XOR:
-            emitByte(OP_XOR);
+            emitByte(parser, OP_XOR);
             break;
         case TOKEN_EQUAL_EQUAL:
-            emitByte(OP_EQUAL);
+            emitByte(parser, OP_EQUAL);
             break;
         case TOKEN_BANG_EQUAL:
-            emitByte(OP_NOT_EQUAL);
+            emitByte(parser, OP_NOT_EQUAL);
             break;
         case TOKEN_GREATER_EQUAL:
-            emitByte(OP_GREATER_EQUAL);
+            emitByte(parser, OP_GREATER_EQUAL);
             break;
         case TOKEN_GREATER:
-            emitByte(OP_GREATER);
+            emitByte(parser, OP_GREATER);
             break;
         case TOKEN_LESS_EQUAL:
-            emitByte(OP_LESS_EQUAL);
+            emitByte(parser, OP_LESS_EQUAL);
             break;
         case TOKEN_LESS:
-            emitByte(OP_LESS);
+            emitByte(parser, OP_LESS);
             break;
         default:
             return;  // Unreachable.
     }
 }
 
+// `a and b`: a falsey left operand stays on the stack and jumps straight
+// to OP_TO_BOOL, so the right operand is only evaluated when it decides
+// the result. Both operators still produce a bool.
+void and_(Parser* parser) {
+    OperandMark lhs = parser->lhsMark;
+    int jumpStart = getCurrentChunk(parser)->count;
+    int endJump = emitJump(parser, OP_JUMP_IF_FALSE);
+    emitByte(parser, OP_POP);
+    int rhsStart = getCurrentChunk(parser)->count;
+    parsePrecedence(parser, PREC_AND + 1);
+
+    if (tryFoldBinary(parser, TOKEN_AND, lhs, jumpStart, rhsStart)) {
+        return;
+    }
+
+    patchJump(parser, endJump);
+    emitByte(parser, OP_TO_BOOL);
+}
+
+void or_(Parser* parser) {
+    OperandMark lhs = parser->lhsMark;
+    int jumpStart = getCurrentChunk(parser)->count;
+    int endJump = emitJump(parser, OP_JUMP_IF_TRUE);
+    emitByte(parser, OP_POP);
+    int rhsStart = getCurrentChunk(parser)->count;
+    parsePrecedence(parser, PREC_OR + 1);
+
+    if (tryFoldBinary(parser, TOKEN_OR, lhs, jumpStart, rhsStart)) {
+        return;
+    }
+
+    patchJump(parser, endJump);
+    emitByte(parser, OP_TO_BOOL);
+}
+
 // utils
-void emitByte(uint8_t byte) {
-    pushChunkEl(getCurrentChunk(), byte, &parser.prev.line, false);
+void emitByte(Parser* parser, uint8_t byte) {
+    pushChunkEl(getCurrentChunk(parser), byte, &parser->prev.line, false);
+}
+
+void emitBytes(Parser* parser, uint8_t byte1, uint8_t byte2) {
+    emitByte(parser, byte1);
+    emitByte(parser, byte2);
+}
+
+void emitConstant(Parser* parser, Value constant) {
+    if (!pushConstantToChunk(getCurrentChunk(parser), constant, &parser->prev.line)) {
+        errorAt(parser, &parser->prev, "Too many constants in one chunk.");
+    }
+}
+
+// bools and nil have their own opcodes, only numbers go to the pool
+void emitValue(Parser* parser, Value value) {
+    if (IS_BOOL(value)) {
+        emitByte(parser, AS_BOOL(value) ? OP_TRUE : OP_FALSE);
+    } else if (IS_NIL(value)) {
+        emitByte(parser, OP_NIL);
+    } else {
+        emitNumber(parser, AS_NUMBER(value));
+    }
+}
+
+// Integral numbers that fit in 16 bits are pushed by an immediate opcode and
+// never reach the pool. -0 keeps its constant, the immediates can't carry
+// the sign, and so does NaN, which fails both range checks and must not
+// reach the cast.
+void emitNumber(Parser* parser, double value) {
+    if (isnan(value) || value < INT16_MIN || value > INT16_MAX || value != (int16_t)value
+        || (value == 0 && signbit(value))) {
+        emitConstant(parser, NUMBER_VAL(value));
+        return;
+    }
+
+    int16_t integer = (int16_t)value;
+    if (integer == 0) {
+        emitByte(parser, OP_ZERO);
+    } else if (integer == 1) {
+        emitByte(parser, OP_ONE);
+    } else if (integer >= INT8_MIN && integer <= INT8_MAX) {
+        emitBytes(parser, OP_PUSH_I8, (uint8_t)(int8_t)integer);
+    } else {
+        emitByte(parser, OP_PUSH_I16);
+        emitBytes(parser, ((uint16_t)integer >> 8) & 0xff, (uint16_t)integer & 0xff);
+    }
 }
 
-void emitBytes(uint8_t byte1, uint8_t byte2) {
-    emitByte(byte1);
-    emitByte(byte2);
+// emits the jump with a placeholder operand, returns the operand offset
+int emitJump(Parser* parser, uint8_t instruction) {
+    emitByte(parser, instruction);
+    emitByte(parser, 0xff);
+    emitByte(parser, 0xff);
+    return getCurrentChunk(parser)->count - 2;
 }
 
-void emitConstant(Value constant) {
-    pushConstantToChunk(getCurrentChunk(), constant, &parser.prev.line);
+void patchJump(Parser* parser, int offset) {
+    Chunk* chunk = getCurrentChunk(parser);
+    // -2 to skip over the operand itself
+    int jump = chunk->count - offset - 2;
+
+    if (jump > UINT16_MAX) {
+        errorAt(parser, &parser->prev, "Too much code to jump over.");
+        return;
+    }
+
+    chunk->data[offset] = (jump >> 8) & 0xff;
+    chunk->data[offset + 1] = jump & 0xff;
 }
 
-void errorAt(Token* token, const char* message) {
-    if (parser.panicMode) {
+void errorAt(Parser* parser, Token* token, const char* message) {
+    if (parser->panicMode) {
         return;
     }
-    parser.panicMode = true;
+    parser->panicMode = true;
 
-    fprintf(stderr, "[line %d] Error", token->line);
+    fprintf(parser->diagnostics, "[line %d] Error", token->line);
 
     if (token->type == TOKEN_EOF) {
-        fprintf(stderr, " at end of file");
+        fprintf(parser->diagnostics, " at end of file");
     } else if (token->type == TOKEN_ERROR) {
     } else {
-        fprintf(stderr, " at '%.*s'", token->length, token->start);
+        fprintf(parser->diagnostics, " at '%.*s'", tokenLength(token), token->start);
     }
 
-    fprintf(stderr, ": %s\n", message);
-    parser.hadError = true;
+    fprintf(parser->diagnostics, ": %s\n", message);
+    parser->hadError = true;
 }
 
-Chunk* getCurrentChunk() { return currentChunk; }
-
-void initParser() {
-    parser.hadError = false;
-    parser.panicMode = false;
+Chunk* getCurrentChunk(Parser* parser) { return parser->chunk; }
+
+void initParser(Parser* parser, const char* source, Chunk* chunk) {
+    initScanner(&parser->scanner, source);
+    parser->tokens = NULL;
+    parser->ring = NULL;
+    parser->prevNumber = 0;
+    parser->currNumber = 0;
+    parser->chunk = chunk;
+    parser->inputNames = NULL;
+    parser->inputCount = 0;
+    parser->diagnostics = stderr;
+    parser->hadError = false;
+    parser->panicMode = false;
 }
 
-void parsePrecedence(Precedence prec) {
-    advanceParser();
-    ParseFn prefixRule = getRule(parser.prev.type)->prefix;
+void parsePrecedence(Parser* parser, Precedence prec) {
+    advanceParser(parser);
+    ParseFn prefixRule = getRule(parser->prev.type)->prefix;
 
     if (prefixRule == NULL) {
-        errorAt(&parser.prev, "Expected expression.");
+        errorAt(parser, &parser->prev, "Expected expression.");
         return;
     }
 
-    prefixRule();
+    OperandMark lhs = markOperand(parser);
+    prefixRule(parser);
 
-    while (prec <= getRule(parser.curr.type)->precedence) {
-        advanceParser();
-        ParseFn infixRule = getRule(parser.prev.type)->infix;
-        infixRule();
+    while (prec <= getRule(parser->curr.type)->precedence) {
+        advanceParser(parser);
+        ParseFn infixRule = getRule(parser->prev.type)->infix;
+        parser->lhsMark = lhs;
+        infixRule(parser);
     }
 }
 
-void expression() { parsePrecedence(PREC_ASSIGNMENT); }
+void expression(Parser* parser) { parsePrecedence(parser, PREC_ASSIGNMENT); }
 
 ParseRule* getRule(TokenType type) { return &rules[type]; }
 
-void endCompiler() {
-    emitByte(OP_RET);
+void endCompiler(Parser* parser) {
+    emitByte(parser, OP_RET);
+    if (!parser->hadError) {
+        optimizeChunk(getCurrentChunk(parser));
+        getCurrentChunk(parser)->maxStackDepth = computeMaxStackDepth(getCurrentChunk(parser));
+    }
 #ifdef DEBUG
-    if (!parser.hadError) {
-        disassembleChunk(getCurrentChunk(), "code");
+    if (!parser->hadError) {
+        disassembleChunk(getCurrentChunk(parser), "code");
+    }
+#endif
+}
+
+// constant folding
+// Replaces the operand code emitted since `operand` with the folded value.
+// Always fails when built with NO_CONSTANT_FOLDING.
+bool tryFoldUnary(Parser* parser, TokenType operatorType, OperandMark operand) {
+#ifdef NO_CONSTANT_FOLDING
+    (void)parser;
+    (void)operatorType;
+    (void)operand;
+    return false;
+#else
+    Value value, folded;
+    if (!readConstantOperand(parser, operand.codeStart, getCurrentChunk(parser)->count, &value)
+        || !foldUnary(operatorType, value, &folded)) {
+        return false;
     }
+
+    discardOperands(parser, operand);
+    emitValue(parser, folded);
+    return true;
 #endif
 }
+
+// Same for a binary operator whose left operand is [lhs, lhsEnd) and right
+// operand runs from rhsStart to the end of the chunk (and/or put their
+// jump in between).
+bool tryFoldBinary(Parser* parser, TokenType operatorType, OperandMark lhs,
+                   int lhsEnd, int rhsStart) {
+#ifdef NO_CONSTANT_FOLDING
+    (void)parser;
+    (void)operatorType;
+    (void)lhs;
+    (void)lhsEnd;
+    (void)rhsStart;
+    return false;
+#else
+    Value a, b, folded;
+    if (!readConstantOperand(parser, lhs.codeStart, lhsEnd, &a)
+        || !readConstantOperand(parser, rhsStart, getCurrentChunk(parser)->count, &b)
+        || !foldBinary(operatorType, a, b, &folded)) {
+        return false;
+    }
+
+    discardOperands(parser, lhs);
+    emitValue(parser, folded);
+    return true;
+#endif
+}
+
+OperandMark markOperand(Parser* parser) {
+    Chunk* chunk = getCurrentChunk(parser);
+    return (OperandMark){chunk->count, chunk->constants.count};
+}
+
+// true if the code in [start, end) is exactly one constant or immediate load
+bool readConstantOperand(Parser* parser, int start, int end, Value* value) {
+    Chunk* chunk = getCurrentChunk(parser);
+
+    if (end - start == 2 && chunk->data[start] == OP_CONSTANT) {
+        *value = chunk->constants.data[chunk->data[start + 1]];
+        return true;
+    }
+    if (end - start == 2 && chunk->data[start] == OP_PUSH_I8) {
+        *value = NUMBER_VAL((int8_t)chunk->data[start + 1]);
+        return true;
+    }
+    if (end - start == 3 && chunk->data[start] == OP_PUSH_I16) {
+        *value = NUMBER_VAL((int16_t)((chunk->data[start + 1] << 8) | chunk->data[start + 2]));
+        return true;
+    }
+    if (end - start == 4 && chunk->data[start] == OP_CONSTANT_LONG) {
+        uint32_t index = (chunk->data[start + 1] << 16)
+                       | (chunk->data[start + 2] << 8) | chunk->data[start + 3];
+        *value = chunk->constants.data[index];
+        return true;
+    }
+    if (end - start != 1) {
+        return false;
+    }
+
+    switch (chunk->data[start]) {
+        case OP_TRUE: *value = BOOL_VAL(true); return true;
+        case OP_FALSE: *value = BOOL_VAL(false); return true;
+        case OP_NIL: *value = NIL_VAL; return true;
+        case OP_ZERO: *value = NUMBER_VAL(0); return true;
+        case OP_ONE: *value = NUMBER_VAL(1); return true;
+        default: return false;
+    }
+}
+
+// drops everything emitted since the mark; constants added after it are
+// only referenced by that code
+void discardOperands(Parser* parser, OperandMark mark) {
+    Chunk* chunk = getCurrentChunk(parser);
+
+    while (chunk->count > mark.codeStart) {
+        popChunkEl(chunk);
+    }
+    while (chunk->constants.count > mark.constantStart) {
+        popConstantFromChunk(chunk);
+    }
+}
+
+// The fold helpers mirror the handlers in run(). They refuse whatever
+// would raise a runtime error, so the error is still reported at runtime.
+bool foldUnary(TokenType operatorType, Value operand, Value* result) {
+    switch (operatorType) {
+        case TOKEN_MINUS:
+            if (!IS_NUMBER(operand)) {
+                return false;
+            }
+            *result = NUMBER_VAL(-AS_NUMBER(operand));
+            return true;
+        case TOKEN_BANG:
+            *result = BOOL_VAL(isFalseyValue(operand));
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool foldBinary(TokenType operatorType, Value a, Value b, Value* result) {
+    switch (operatorType) {
+        case TOKEN_AND:
+            *result = BOOL_VAL(toBool(a) && toBool(b));
+            return true;
+        case TOKEN_OR:
+            *result = BOOL_VAL(toBool(a) || toBool(b));
+            return true;
+        case TOKEN_XOR:
+            *result = BOOL_VAL(toBool(a) ^ toBool(b));
+            return true;
+        case TOKEN_EQUAL_EQUAL:
+            *result = BOOL_VAL(areValuesEqual(a, b));
+            return true;
+        case TOKEN_BANG_EQUAL:
+            *result = BOOL_VAL(!areValuesEqual(a, b));
+            return true;
+        default:
+            break;
+    }
+
+    if (!IS_NUMBER(a) || !IS_NUMBER(b)) {
+        return false;
+    }
+
+    double x = AS_NUMBER(a);
+    double y = AS_NUMBER(b);
+
+    switch (operatorType) {
+        case TOKEN_PLUS: *result = NUMBER_VAL(x + y); return true;
+        case TOKEN_MINUS: *result = NUMBER_VAL(x - y); return true;
+        case TOKEN_STAR: *result = NUMBER_VAL(x * y); return true;
+        case TOKEN_SLASH: *result = NUMBER_VAL(x / y); return true;
+        case TOKEN_GREATER: *result = BOOL_VAL(x > y); return true;
+        case TOKEN_GREATER_EQUAL: *result = BOOL_VAL(x >= y); return true;
+        case TOKEN_LESS: *result = BOOL_VAL(x < y); return true;
+        case TOKEN_LESS_EQUAL: *result = BOOL_VAL(x <= y); return true;
+        default: return false;
+    }
+}
@@ -3,51 +3,123 @@
 #include "debug.h"
 #include <stdio.h>
 
+static const char* opcodeNames[] = {
+    [OP_RET] = "OP_RET",
+    [OP_NIL] = "OP_NIL",
+    [OP_CONSTANT] = "OP_CONSTANT",
+    [OP_CONSTANT_LONG] = "OP_CONSTANT_LONG",
+    [OP_ZERO] = "OP_ZERO",
+    [OP_ONE] = "OP_ONE",
+    [OP_PUSH_I8] = "OP_PUSH_I8",
+    [OP_PUSH_I16] = "OP_PUSH_I16",
+    [OP_GET_INPUT] = "OP_GET_INPUT",
+    [OP_POP] = "OP_POP",
+    [OP_JUMP] = "OP_JUMP",
+    [OP_JUMP_IF_FALSE] = "OP_JUMP_IF_FALSE",
+    [OP_JUMP_IF_TRUE] = "OP_JUMP_IF_TRUE",
+    [OP_TRUE] = "OP_TRUE",
+    [OP_FALSE] = "OP_FALSE",
+    [OP_NOT] = "OP_NOT",
+    [OP_TO_BOOL] = "OP_TO_BOOL",
+    [OP_XOR] = "OP_XOR",
+    [OP_EQUAL] = "OP_EQUAL",
+    [OP_NOT_EQUAL] = "OP_NOT_EQUAL",
+    [OP_GREATER] = "OP_GREATER",
+    [OP_LESS] = "OP_LESS",
+    [OP_GREATER_EQUAL] = "OP_GREATER_EQUAL",
+    [OP_LESS_EQUAL] = "OP_LESS_EQUAL",
+    [OP_NEGATE] = "OP_NEGATE",
+    [OP_INC] = "OP_INC",
+    [OP_DEC] = "OP_DEC",
+    [OP_ADD] = "OP_ADD",
+    [OP_SUB] = "OP_SUB",
+    [OP_MULT] = "OP_MULT",
+    [OP_DIV] = "OP_DIV",
+    [OP_ADD_CONST] = "OP_ADD_CONST",
+    [OP_SUB_CONST] = "OP_SUB_CONST",
+    [OP_MULT_CONST] = "OP_MULT_CONST",
+    [OP_DIV_CONST] = "OP_DIV_CONST",
+    [OP_GREATER_CONST] = "OP_GREATER_CONST",
+    [OP_LESS_CONST] = "OP_LESS_CONST",
+    [OP_GREATER_EQUAL_CONST] = "OP_GREATER_EQUAL_CONST",
+    [OP_LESS_EQUAL_CONST] = "OP_LESS_EQUAL_CONST",
+    [OP_ADD_IMM] = "OP_ADD_IMM",
+    [OP_SUB_IMM] = "OP_SUB_IMM",
+    [OP_MULT_IMM] = "OP_MULT_IMM",
+    [OP_DIV_IMM] = "OP_DIV_IMM",
+    [OP_GREATER_IMM] = "OP_GREATER_IMM",
+    [OP_LESS_IMM] = "OP_LESS_IMM",
+    [OP_GREATER_EQUAL_IMM] = "OP_GREATER_EQUAL_IMM",
+    [OP_LESS_EQUAL_IMM] = "OP_LESS_EQUAL_IMM",
+    [OP_ADD_NUM] = "OP_ADD_NUM",
+    [OP_SUB_NUM] = "OP_SUB_NUM",
+    [OP_MULT_NUM] = "OP_MULT_NUM",
+    [OP_DIV_NUM] = "OP_DIV_NUM",
+    [OP_GREATER_NUM] = "OP_GREATER_NUM",
+    [OP_LESS_NUM] = "OP_LESS_NUM",
+    [OP_GREATER_EQUAL_NUM] = "OP_GREATER_EQUAL_NUM",
+    [OP_LESS_EQUAL_NUM] = "OP_LESS_EQUAL_NUM",
+    [OP_EQUAL_NUM] = "OP_EQUAL_NUM",
+    [OP_NOT_EQUAL_NUM] = "OP_NOT_EQUAL_NUM",
+};
+
+const char* opcodeName(uint8_t opcode) {
+    if (opcode >= sizeof(opcodeNames) / sizeof(opcodeNames[0]) || opcodeNames[opcode] == NULL) {
+        return "OP_UNKNOWN";
+    }
+    return opcodeNames[opcode];
+}
+
 int disassembleInstruction(Chunk* chunk, int offset) {
     printf("%04d ", offset);
+    int line = getLine(chunk, offset);
+    if (offset > 0 && line == getLine(chunk, offset - 1)) {
+        printf("   | ");
+    } else {
+        printf("%4d ", line);
+    }
+
     uint8_t instruction = chunk->data[offset];
+    const char* name = opcodeName(instruction);
 
     switch (instruction) {
-    case OP_RET:
-        return printSingleByteInstruction("OP_RET", offset);
     case OP_CONSTANT:
-        return printConstantInstruction(chunk, "OP_CONSTANT", offset);
-    case OP_TRUE:
-        return printSingleByteInstruction("OP_TRUE", offset);
-    case OP_FALSE:
-        return printSingleByteInstruction("OP_FALSE", offset);
-    case OP_NIL:
-        return printSingleByteInstruction("OP_NIL", offset);
-    case OP_NOT:
-        return printSingleByteInstruction("OP_NOT", offset);
-    case OP_EQUAL:
-        return printSingleByteInstruction("OP_EQUAL", offset);
-    case OP_GREATER_EQUAL:
-        return printSingleByteInstruction("OP_GREATER_EQUAL", offset);
-    case OP_GREATER:
-        return printSingleByteInstruction("OP_GREATER", offset);
-    case OP_LESS_EQUAL:
-        return printSingleByteInstruction("OP_LESS_EQUAL", offset);
-    case OP_LESS:
-        return printSingleByteInstruction("OP_LESS", offset);
-    case OP_NEGATE:
-        return printSingleByteInstruction("OP_NEGATE", offset);
-    case OP_INC:
-        return printSingleByteInstruction("OP_INC", offset);
-    case OP_DEC:
-        return printSingleByteInstruction("OP_DEC", offset);
-    case OP_ADD:
-        return printSingleByteInstruction("OP_ADD", offset);
-    case OP_SUB:
-        return printSingleByteInstruction("OP_SUB", offset);
-    case OP_MULT:
-        return printSingleByteInstruction("OP_MULT", offset);
-    case OP_DIV:
-        return printSingleByteInstruction("OP_DIV", offset);
+    case OP_ADD_CONST:
+    case OP_SUB_CONST:
+    case OP_MULT_CONST:
+    case OP_DIV_CONST:
+    case OP_GREATER_CONST:
+    case OP_LESS_CONST:
+    case OP_GREATER_EQUAL_CONST:
+    case OP_LESS_EQUAL_CONST:
+        return printConstantInstruction(chunk, name, offset);
+    case OP_CONSTANT_LONG:
+        return printConstantLongInstruction(chunk, name, offset);
+    case OP_PUSH_I8:
+    case OP_PUSH_I16:
+    case OP_ADD_IMM:
+    case OP_SUB_IMM:
+    case OP_MULT_IMM:
+    case OP_DIV_IMM:
+    case OP_GREATER_IMM:
+    case OP_LESS_IMM:
+    case OP_GREATER_EQUAL_IMM:
+    case OP_LESS_EQUAL_IMM:
+        return printImmediateInstruction(chunk, name, offset);
+    case OP_GET_INPUT:
+        return printInputInstruction(chunk, name, offset);
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+        return printJumpInstruction(chunk, name, 1, offset);
     default:
-        printf("Unrecognized instruction %d at offset: %d\n", instruction,
-               offset);
-        return offset + 1;
+        if (instruction > OP_NOT_EQUAL_NUM) {
+            printf("Unrecognized instruction %d at offset: %d\n", instruction,
+                   offset);
+            return offset + 1;
+        }
+        // everything else has no operand
+        return printSingleByteInstruction(name, offset);
     }
 }
 
@@ -72,3 +144,138 @@ int printConstantInstruction(Chunk* chunk, const char* name, int offset) {
 
     return offset + 2;
 }
+
+int printConstantLongInstruction(Chunk* chunk, const char* name, int offset) {
+    uint32_t index = (chunk->data[offset + 1] << 16)
+                   | (chunk->data[offset + 2] << 8) | chunk->data[offset + 3];
+    Value val = chunk->constants.data[index];
+
+    printf("%s; value: %lf; offset: %u\n", name, AS_NUMBER(val), index);
+
+    return offset + 4;
+}
+
+int printImmediateInstruction(Chunk* chunk, const char* name, int offset) {
+    if (instructionLength(chunk->data[offset]) == 2) {
+        printf("%s; value: %d\n", name, (int8_t)chunk->data[offset + 1]);
+        return offset + 2;
+    }
+
+    int16_t value = (int16_t)((chunk->data[offset + 1] << 8) | chunk->data[offset + 2]);
+    printf("%s; value: %d\n", name, value);
+    return offset + 3;
+}
+
+int printInputInstruction(Chunk* chunk, const char* name, int offset) {
+    printf("%s; input: %d\n", name, chunk->data[offset + 1]);
+    return offset + 2;
+}
+
+int printJumpInstruction(Chunk* chunk, const char* name, int sign, int offset) {
+    uint16_t jump = (uint16_t)(chunk->data[offset + 1] << 8);
+    jump |= chunk->data[offset + 2];
+
+    printf("%s; %d -> %d\n", name, offset, offset + 3 + sign * jump);
+
+    return offset + 3;
+}
+
+static const char* registerOpName(uint8_t op) {
+    switch (op) {
+        case REG_RET: return "REG_RET";
+        case REG_MOVE: return "REG_MOVE";
+        case REG_JUMP: return "REG_JUMP";
+        case REG_JUMP_IF_FALSE: return "REG_JUMP_IF_FALSE";
+        case REG_JUMP_IF_TRUE: return "REG_JUMP_IF_TRUE";
+        case REG_NOT: return "REG_NOT";
+        case REG_TO_BOOL: return "REG_TO_BOOL";
+        case REG_NEGATE: return "REG_NEGATE";
+        case REG_XOR: return "REG_XOR";
+        case REG_EQUAL: return "REG_EQUAL";
+        case REG_NOT_EQUAL: return "REG_NOT_EQUAL";
+        case REG_GREATER: return "REG_GREATER";
+        case REG_LESS: return "REG_LESS";
+        case REG_GREATER_EQUAL: return "REG_GREATER_EQUAL";
+        case REG_LESS_EQUAL: return "REG_LESS_EQUAL";
+        case REG_ADD: return "REG_ADD";
+        case REG_SUB: return "REG_SUB";
+        case REG_MULT: return "REG_MULT";
+        case REG_DIV: return "REG_DIV";
+        default: return NULL;
+    }
+}
+
+// r<n> for a register, k<n>(value) for a pool constant, #value for an
+// immediate, i<n> for an input
+static void printOperand(RegisterChunk* code, Chunk* chunk, uint32_t operand) {
+    uint32_t index = operand & OPERAND_INDEX_MASK;
+
+    switch (operand >> OPERAND_KIND_SHIFT) {
+        case OPERAND_REGISTER:
+            printf("r%u", index);
+            break;
+        case OPERAND_CONSTANT:
+            printf("k%u(", index);
+            printValue(chunk->constants.data[index]);
+            printf(")");
+            break;
+        case OPERAND_IMMEDIATE:
+            printf("#");
+            printValue(code->immediates.data[index]);
+            break;
+        default:
+            printf("i%u", index);
+            break;
+    }
+}
+
+void disassembleRegisterInstruction(RegisterChunk* code, Chunk* chunk, int index) {
+    RegisterInstruction* instruction = &code->code[index];
+    const char* name = registerOpName(instruction->op);
+
+    printf("%04d %4d ", index, getLine(chunk, code->offsets[index]));
+    if (name == NULL) {
+        printf("Unrecognized instruction %d\n", instruction->op);
+        return;
+    }
+    printf("%s", name);
+
+    switch (instruction->op) {
+        case REG_RET:
+            printf(" ");
+            printOperand(code, chunk, instruction->b);
+            break;
+        case REG_JUMP:
+            printf(" -> %u", instruction->b);
+            break;
+        case REG_JUMP_IF_FALSE:
+        case REG_JUMP_IF_TRUE:
+            printf(" ");
+            printOperand(code, chunk, instruction->c);
+            printf(" -> %u", instruction->b);
+            break;
+        case REG_MOVE:
+        case REG_NOT:
+        case REG_TO_BOOL:
+        case REG_NEGATE:
+            printf(" r%u, ", instruction->dst);
+            printOperand(code, chunk, instruction->b);
+            break;
+        default:
+            printf(" r%u, ", instruction->dst);
+            printOperand(code, chunk, instruction->b);
+            printf(", ");
+            printOperand(code, chunk, instruction->c);
+            break;
+    }
+    printf("\n");
+}
+
+void disassembleRegisterChunk(RegisterChunk* code, Chunk* chunk, const char* name) {
+    printf("== %s ==\n", name);
+
+    for (int i = 0; i < code->count; ++i) {
+        disassembleRegisterInstruction(code, chunk, i);
+    }
+    printf("\n");
+}
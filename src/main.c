@@ -1,24 +1,79 @@
+#include "batch_compiler.h"
+#include "result_writer.h"
 #include "scanner.h"
+#include "trace.h"
 #include "vm.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 int main(int argc, const char* argv[]) {
+    if (argc >= 3 && strcmp(argv[1], "--compile-only") == 0) {
+        return compileBatch(argv + 2, argc - 2);
+    }
+    if (argc == 3 && strcmp(argv[1], "--decode-trace") == 0) {
+        return decodeTrace(argv[2]);
+    }
+
     VM vm;
     initVM(&vm);
 
-    if (argc == 1) {
+    bool showMemory = false;
+    bool stream = false;
+    bool buffered = false;
+    for (; argc >= 2 && strncmp(argv[1], "--", 2) == 0; argv++, argc--) {
+        if (strcmp(argv[1], "--register-vm") == 0) {
+            vm.backend = BACKEND_REGISTER;
+        } else if (strcmp(argv[1], "--mem-stats") == 0) {
+            showMemory = true;
+        } else if (strcmp(argv[1], "--stream") == 0) {
+            stream = true;
+        } else if (strcmp(argv[1], "--buffered-output") == 0) {
+            buffered = true;
+        } else {
+            break;
+        }
+    }
+
+    // results in shortest round-trip form, written out in blocks
+    ResultWriter output;
+    if (buffered) {
+        initResultWriter(&output, STDOUT_FILENO);
+        vm.output = &output;
+    }
+
+    int status = 0;
+    if (argc == 1 && stream) {
+        status = runStream(&vm, "-");
+    } else if (argc == 1) {
         repl(&vm);
     } else if (argc == 2) {
-        runFile(&vm, argv[1]);
+        status = stream ? runStream(&vm, argv[1]) : runFile(&vm, argv[1]);
     } else {
-        fprintf(stderr, "Usage: clox [path]\n");
+        fprintf(stderr, "Usage: orion [--register-vm] [--mem-stats] [--stream] "
+                        "[--buffered-output] [path]\n"
+                        "       orion --compile-only <dir|file>...\n"
+                        "       orion --decode-trace <file>\n");
         exit(64);
     }
 
+    if (buffered && !freeResultWriter(&output)) {
+        fprintf(stderr, "Could not write results.\n");
+        status = status != 0 ? status : 74;
+    }
+
+    // before freeVM, so the stack still shows as live; the thread's table
+    // adds compiling, which the VM doesn't own
+    if (showMemory) {
+        printMemoryStats(vmMemoryStats(&vm), "vm", stderr);
+        printMemoryStats(memoryStats(), "thread", stderr);
+    }
+
+    // after a failed run too, so a PROFILE build still dumps its profile
     freeVM(&vm);
 
-    return 0;
+    return status;
 }
@@ -1,12 +1,61 @@
+#include <string.h>
+
 #include "orion_memory.h"
 
-void* reallocate(void* pointer, size_t size) {
-    if (size == 0) {
+static _Thread_local MemoryStats threadStats;
+// owner of what this thread allocates right now, NULL for none
+static _Thread_local MemoryStats* currentStats = NULL;
+
+// Frees can arrive on counters that never saw the allocation, a chunk
+// released on another thread than it was compiled on for one, so live
+// bytes stop at zero instead of wrapping.
+static void countBytes(MemoryCounters* counters, size_t oldSize, size_t newSize) {
+    if (newSize >= oldSize) {
+        counters->liveBytes += newSize - oldSize;
+    } else {
+        size_t freed = oldSize - newSize;
+        counters->liveBytes = freed < counters->liveBytes ? counters->liveBytes - freed : 0;
+    }
+    if (counters->liveBytes > counters->peakBytes) {
+        counters->peakBytes = counters->liveBytes;
+    }
+}
+
+static void countCall(MemoryCounters* counters, void* pointer, size_t newSize) {
+    if (newSize == 0) {
+        counters->frees++;
+    } else if (pointer == NULL) {
+        counters->allocations++;
+    } else {
+        counters->reallocations++;
+    }
+}
+
+static void countHeap(MemoryStats* stats, MemoryCategory category, void* pointer,
+                      size_t oldSize, size_t newSize) {
+    countCall(&stats->total, pointer, newSize);
+    countCall(&stats->categories[category], pointer, newSize);
+    countBytes(&stats->total, oldSize, newSize);
+    countBytes(&stats->categories[category], oldSize, newSize);
+}
+
+static void* reallocateFor(MemoryStats* owner, MemoryCategory category, void* pointer,
+                           size_t oldSize, size_t newSize) {
+    if (pointer == NULL && newSize == 0) {
+        return NULL;
+    }
+
+    countHeap(&threadStats, category, pointer, oldSize, newSize);
+    if (owner != NULL) {
+        countHeap(owner, category, pointer, oldSize, newSize);
+    }
+
+    if (newSize == 0) {
         free(pointer);
         return NULL;
     }
 
-    void* result = realloc(pointer, size);
+    void* result = realloc(pointer, newSize);
 
     if (result == NULL) {
         free(pointer);
@@ -15,3 +64,229 @@ void* reallocate(void* pointer, size_t size) {
 
     return result;
 }
+
+void* reallocate(MemoryCategory category, void* pointer, size_t oldSize, size_t newSize) {
+    return reallocateFor(currentStats, category, pointer, oldSize, newSize);
+}
+
+// everything allocated and freed on this thread, whoever owned it
+MemoryStats* memoryStats(void) {
+    return &threadStats;
+}
+
+// Makes stats (NULL for none) the owner of this thread's allocations and
+// returns the previous one, which the caller has to put back before it
+// returns.
+MemoryStats* useMemoryStats(MemoryStats* stats) {
+    MemoryStats* previous = currentStats;
+    currentStats = stats;
+    return previous;
+}
+
+void initMemoryStats(MemoryStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+// starts a new high-water mark at the current live bytes
+void resetMemoryPeaks(MemoryStats* stats) {
+    stats->total.peakBytes = stats->total.liveBytes;
+    for (int i = 0; i < MEM_CATEGORY_COUNT; ++i) {
+        stats->categories[i].peakBytes = stats->categories[i].liveBytes;
+    }
+}
+
+static void printCounters(FILE* out, const char* name, MemoryCounters* counters) {
+    fprintf(out, "%-14s %10llu %10llu %10llu %12zu %12zu\n", name,
+            (unsigned long long)counters->allocations,
+            (unsigned long long)counters->reallocations,
+            (unsigned long long)counters->frees, counters->liveBytes, counters->peakBytes);
+}
+
+void printMemoryStats(MemoryStats* stats, const char* name, FILE* out) {
+    static const char* names[MEM_CATEGORY_COUNT] = {
+        [MEM_CHUNK] = "chunk",
+        [MEM_CONSTANTS] = "constants",
+        [MEM_STACK] = "stack",
+        [MEM_REGISTER_CODE] = "register code",
+        [MEM_COMPILER] = "compiler",
+        [MEM_STRINGS] = "strings",
+        [MEM_CACHE] = "cache",
+        [MEM_DIAGNOSTICS] = "diagnostics",
+        [MEM_ARENA] = "arena slack",
+    };
+
+    fprintf(out, "== %s memory ==\n", name);
+    fprintf(out, "%-14s %10s %10s %10s %12s %12s\n", "category", "allocs", "reallocs", "frees",
+            "live bytes", "peak bytes");
+    for (int i = 0; i < MEM_CATEGORY_COUNT; ++i) {
+        printCounters(out, names[i], &stats->categories[i]);
+    }
+    printCounters(out, "total", &stats->total);
+}
+
+// NUL-terminated copy, released with freeString
+char* copyString(const char* chars, size_t length) {
+    char* string = ALLOCATE(MEM_STRINGS, char, length + 1);
+    memcpy(string, chars, length);
+    string[length] = '\0';
+    return string;
+}
+
+void freeString(char* string) {
+    if (string != NULL) {
+        FREE_ARRAY(MEM_STRINGS, char, string, strlen(string) + 1);
+    }
+}
+
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+static void moveArenaBytes(MemoryStats* stats, MemoryCategory category, size_t oldSize,
+                           size_t newSize) {
+    countBytes(&stats->categories[category], oldSize, newSize);
+    countBytes(&stats->categories[MEM_ARENA], newSize, oldSize);
+}
+
+// Arena allocations don't reach the heap, so only the category counters
+// move: bytes go from MEM_ARENA to category and back.
+static void countArenaBytes(Arena* arena, MemoryCategory category, size_t oldSize,
+                            size_t newSize) {
+    moveArenaBytes(&threadStats, category, oldSize, newSize);
+    if (arena->stats != NULL) {
+        moveArenaBytes(arena->stats, category, oldSize, newSize);
+    }
+    arena->categoryBytes[category] += newSize - oldSize;
+}
+
+static void countArenaCall(Arena* arena, MemoryCategory category, void* pointer,
+                           size_t newSize) {
+    countCall(&threadStats.categories[category], pointer, newSize);
+    if (arena->stats != NULL) {
+        countCall(&arena->stats->categories[category], pointer, newSize);
+    }
+}
+
+// stats (or NULL) counts the arena as its owner wherever it is used
+void initArena(Arena* arena, MemoryStats* stats) {
+    arena->stats = stats;
+    arena->blocks = NULL;
+    arena->last = NULL;
+    arena->reserved = 0;
+    memset(arena->categoryBytes, 0, sizeof(arena->categoryBytes));
+    memset(arena->categoryAllocations, 0, sizeof(arena->categoryAllocations));
+}
+
+void freeArena(Arena* arena) {
+    // whatever is still handed out goes back as freed in bulk
+    for (int i = 0; i < MEM_CATEGORY_COUNT; ++i) {
+        threadStats.categories[i].frees += arena->categoryAllocations[i];
+        if (arena->stats != NULL) {
+            arena->stats->categories[i].frees += arena->categoryAllocations[i];
+        }
+        if (arena->categoryBytes[i] > 0) {
+            countArenaBytes(arena, (MemoryCategory)i, arena->categoryBytes[i], 0);
+        }
+    }
+
+    ArenaBlock* block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        reallocateFor(arena->stats, MEM_ARENA, block, sizeof(ArenaBlock) + block->capacity, 0);
+        block = next;
+    }
+    initArena(arena, arena->stats);
+}
+
+// Blocks double up to ARENA_MAX_BLOCK_SIZE, so a big compilation takes a
+// handful of mallocs and a small one a single page.
+static ArenaBlock* newArenaBlock(Arena* arena, size_t size) {
+    size_t capacity = ARENA_BLOCK_SIZE;
+    if (arena->blocks != NULL && arena->blocks->capacity < ARENA_MAX_BLOCK_SIZE) {
+        capacity = arena->blocks->capacity * 2;
+    } else if (arena->blocks != NULL) {
+        capacity = ARENA_MAX_BLOCK_SIZE;
+    }
+    if (capacity < size) {
+        capacity = size;
+    }
+
+    // the header is counted too so the block frees back to zero
+    ArenaBlock* block = (ArenaBlock*)reallocateFor(arena->stats, MEM_ARENA, NULL, 0,
+                                                   sizeof(ArenaBlock) + capacity);
+    block->next = arena->blocks;
+    block->capacity = capacity;
+    block->used = 0;
+    arena->blocks = block;
+    arena->reserved += sizeof(ArenaBlock) + capacity;
+    return block;
+}
+
+static void* bump(Arena* arena, size_t size) {
+    ArenaBlock* block = arena->blocks;
+    if (block == NULL || block->capacity - block->used < size) {
+        block = newArenaBlock(arena, size);
+    }
+
+    void* result = block->data + block->used;
+    block->used += size;
+    arena->last = result;
+    return result;
+}
+
+void* arenaAllocate(Arena* arena, MemoryCategory category, size_t size) {
+    size = ARENA_ALIGN(size);
+    void* result = bump(arena, size);
+    countArenaCall(arena, category, NULL, size);
+    countArenaBytes(arena, category, 0, size);
+    arena->categoryAllocations[category]++;
+    return result;
+}
+
+void* arenaReallocate(Arena* arena, MemoryCategory category, void* pointer, size_t oldSize,
+                      size_t newSize) {
+    if (arena == NULL) {
+        return reallocate(category, pointer, oldSize, newSize);
+    }
+    if (pointer == NULL) {
+        return newSize == 0 ? NULL : arenaAllocate(arena, category, newSize);
+    }
+
+    countArenaCall(arena, category, pointer, newSize);
+    oldSize = ARENA_ALIGN(oldSize);
+    newSize = ARENA_ALIGN(newSize);
+
+    // the newest allocation ends at the head block's bump pointer, so it
+    // can be resized where it is
+    ArenaBlock* block = arena->blocks;
+    if (pointer == arena->last) {
+        size_t start = (size_t)((unsigned char*)pointer - block->data);
+        if (newSize == 0) {
+            block->used = start;
+            arena->last = NULL;
+            countArenaBytes(arena, category, oldSize, 0);
+            arena->categoryAllocations[category]--;
+            return NULL;
+        }
+        if (block->capacity - start >= newSize) {
+            block->used = start + newSize;
+            countArenaBytes(arena, category, oldSize, newSize);
+            return pointer;
+        }
+    }
+
+    // anywhere else a shrink stays put and only its tail goes dead, a
+    // move leaves all of the old bytes dead until the arena is freed
+    if (newSize > 0 && newSize <= oldSize) {
+        countArenaBytes(arena, category, oldSize, newSize);
+        return pointer;
+    }
+    countArenaBytes(arena, category, oldSize, 0);
+    if (newSize == 0) {
+        arena->categoryAllocations[category]--;
+        return NULL;
+    }
+
+    void* result = bump(arena, newSize);
+    countArenaBytes(arena, category, 0, newSize);
+    memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+    return result;
+}
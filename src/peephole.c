@@ -0,0 +1,201 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk.h"
+#include "orion_memory.h"
+#include "peephole.h"
+
+// superinstruction for `OP_CONSTANT k; opcode`, or OP_RET if there is none
+uint8_t fusedConstantOp(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD: return OP_ADD_CONST;
+        case OP_SUB: return OP_SUB_CONST;
+        case OP_MULT: return OP_MULT_CONST;
+        case OP_DIV: return OP_DIV_CONST;
+        case OP_GREATER: return OP_GREATER_CONST;
+        case OP_LESS: return OP_LESS_CONST;
+        case OP_GREATER_EQUAL: return OP_GREATER_EQUAL_CONST;
+        case OP_LESS_EQUAL: return OP_LESS_EQUAL_CONST;
+        default: return OP_RET;
+    }
+}
+
+// superinstruction for `OP_ZERO/OP_ONE/OP_PUSH_I8; opcode`, or OP_RET if
+// there is none. OP_PUSH_I16 stays apart, its value doesn't fit the operand.
+uint8_t fusedImmediateOp(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD: return OP_ADD_IMM;
+        case OP_SUB: return OP_SUB_IMM;
+        case OP_MULT: return OP_MULT_IMM;
+        case OP_DIV: return OP_DIV_IMM;
+        case OP_GREATER: return OP_GREATER_IMM;
+        case OP_LESS: return OP_LESS_IMM;
+        case OP_GREATER_EQUAL: return OP_GREATER_EQUAL_IMM;
+        case OP_LESS_EQUAL: return OP_LESS_EQUAL_IMM;
+        default: return OP_RET;
+    }
+}
+
+static bool isSmallIntegerPush(uint8_t opcode) {
+    return opcode == OP_ZERO || opcode == OP_ONE || opcode == OP_PUSH_I8;
+}
+
+// the operand byte of the fused form, the integer as int8_t
+static uint8_t pushedInteger(Chunk* chunk, int offset) {
+    switch (chunk->data[offset]) {
+        case OP_ZERO: return 0;
+        case OP_ONE: return 1;
+        default: return chunk->data[offset + 1];
+    }
+}
+
+// single instruction for `OP_ONE; opcode`, or OP_RET if there is none
+uint8_t fusedOneOp(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD: return OP_INC;
+        case OP_SUB: return OP_DEC;
+        default: return OP_RET;
+    }
+}
+
+// single instruction for `opcode; OP_NOT`, or OP_RET if there is none.
+// Comparisons are left alone: !(a < b) is not a >= b once NaN is involved.
+uint8_t fusedNotOp(uint8_t opcode) {
+    switch (opcode) {
+        case OP_EQUAL: return OP_NOT_EQUAL;
+        case OP_NOT_EQUAL: return OP_EQUAL;
+        case OP_NOT: return OP_TO_BOOL;
+        default: return OP_RET;
+    }
+}
+
+static bool isJump(uint8_t opcode) {
+    return opcode == OP_JUMP || opcode == OP_JUMP_IF_FALSE || opcode == OP_JUMP_IF_TRUE;
+}
+
+static int jumpTarget(Chunk* chunk, int offset) {
+    uint16_t jump = (uint16_t)((chunk->data[offset + 1] << 8) | chunk->data[offset + 2]);
+    return offset + 3 + jump;
+}
+
+// Rewrites the finished chunk with common pairs fused into one instruction
+// (see fusedConstantOp/fusedImmediateOp/fusedOneOp/fusedNotOp). Pairs whose
+// second half is a jump target stay apart. Jump offsets and the line table
+// are rebuilt for the shorter code; the constant pool is shared unchanged.
+void optimizeChunk(Chunk* chunk) {
+    int count = chunk->count;
+    bool* isTarget = ALLOCATE(MEM_COMPILER, bool, count + 1);
+    memset(isTarget, 0, sizeof(bool) * (count + 1));
+    // old offset -> new offset, one past the end included for jumps to it
+    int* newOffset = ALLOCATE(MEM_COMPILER, int, count + 1);
+    // the line table expanded to one entry per byte; getLine() rescans the
+    // runs on every call, which is quadratic over a whole chunk
+    int* lines = ALLOCATE(MEM_COMPILER, int, count + 1);
+    for (int32_t run = 0, offset = 0; run < chunk->lineCount; ++run) {
+        for (int32_t i = 0; i < chunk->lines[run].count; ++i) {
+            lines[offset++] = chunk->lines[run].line;
+        }
+    }
+
+    for (int offset = 0; offset < count; offset += instructionLength(chunk->data[offset])) {
+        if (isJump(chunk->data[offset])) {
+            isTarget[jumpTarget(chunk, offset)] = true;
+        }
+    }
+
+    Chunk optimized;
+    initChunk(&optimized);
+
+    for (int offset = 0; offset < count;) {
+        uint8_t opcode = chunk->data[offset];
+        int length = instructionLength(opcode);
+        int next = offset + length;
+        int line = lines[offset];
+        newOffset[offset] = optimized.count;
+
+        if (next < count && !isTarget[next]) {
+            uint8_t nextOpcode = chunk->data[next];
+            int nextLine = lines[next];
+            uint8_t fused = OP_RET;
+
+            if (opcode == OP_CONSTANT) {
+                fused = fusedConstantOp(nextOpcode);
+            }
+            if (fused != OP_RET) {
+                // the error, if any, belongs to the operator's line
+                pushChunkEl(&optimized, fused, &nextLine, false);
+                pushChunkEl(&optimized, chunk->data[offset + 1], &nextLine, false);
+                newOffset[next] = newOffset[offset];
+                offset = next + 1;
+                continue;
+            }
+
+            // 1 + and 1 - have single-byte forms of their own
+            if (isSmallIntegerPush(opcode)
+                && !(opcode == OP_ONE && fusedOneOp(nextOpcode) != OP_RET)) {
+                fused = fusedImmediateOp(nextOpcode);
+            }
+            if (fused != OP_RET) {
+                pushChunkEl(&optimized, fused, &nextLine, false);
+                pushChunkEl(&optimized, pushedInteger(chunk, offset), &nextLine, false);
+                newOffset[next] = newOffset[offset];
+                offset = next + 1;
+                continue;
+            }
+
+            if (opcode == OP_ONE) {
+                fused = fusedOneOp(nextOpcode);
+            }
+            if (nextOpcode == OP_NOT) {
+                fused = fusedNotOp(opcode);
+            }
+            if (fused != OP_RET) {
+                pushChunkEl(&optimized, fused, &nextLine, false);
+                newOffset[next] = newOffset[offset];
+                offset = next + 1;
+                continue;
+            }
+        }
+
+        for (int i = 0; i < length; ++i) {
+            pushChunkEl(&optimized, chunk->data[offset + i], &line, false);
+        }
+        offset = next;
+    }
+    newOffset[count] = optimized.count;
+
+    for (int offset = 0; offset < count; offset += instructionLength(chunk->data[offset])) {
+        if (!isJump(chunk->data[offset])) {
+            continue;
+        }
+
+        // code only shrinks, so the patched jump still fits in 16 bits
+        int from = newOffset[offset];
+        int jump = newOffset[jumpTarget(chunk, offset)] - (from + 3);
+        optimized.data[from + 1] = (jump >> 8) & 0xff;
+        optimized.data[from + 2] = jump & 0xff;
+    }
+
+    FREE_ARRAY(MEM_COMPILER, bool, isTarget, count + 1);
+    FREE_ARRAY(MEM_COMPILER, int, newOffset, count + 1);
+    FREE_ARRAY(MEM_COMPILER, int, lines, count + 1);
+
+    // The rewrite was built in a scratch chunk with its own arena. It goes
+    // back into this chunk's own buffers, which are then shrunk in place:
+    // freeing them inside the arena would only leave them dead. The code
+    // only shrinks, and each line run of the rewrite comes from a run of
+    // the original, so both fit.
+    assert(optimized.count <= chunk->capacity && optimized.lineCount <= chunk->lineCapacity);
+    memcpy(chunk->data, optimized.data, optimized.count);
+    chunk->data = ARENA_GROW_ARRAY(chunk->arena, MEM_CHUNK, uint8_t, chunk->data,
+                                   chunk->capacity, optimized.count);
+    chunk->count = optimized.count;
+    chunk->capacity = optimized.count;
+    memcpy(chunk->lines, optimized.lines, sizeof(LineRun) * optimized.lineCount);
+    chunk->lines = ARENA_GROW_ARRAY(chunk->arena, MEM_CHUNK, LineRun, chunk->lines,
+                                    chunk->lineCapacity, optimized.lineCount);
+    chunk->lineCount = optimized.lineCount;
+    chunk->lineCapacity = optimized.lineCount;
+    freeChunk(&optimized);
+}
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk.h"
+#include "debug.h"
+#include "orion_memory.h"
+#include "profiler.h"
+
+#define PROFILE_SPOTS_CAPACITY 64
+// hot spots listed by dumpProfile
+#define PROFILE_TOP_SPOTS 20
+
+void initProfile(Profile* profile) {
+    memset(profile->opcodeCounts, 0, sizeof(profile->opcodeCounts));
+    memset(profile->opcodeCycles, 0, sizeof(profile->opcodeCycles));
+    memset(profile->opcodeSamples, 0, sizeof(profile->opcodeSamples));
+    profile->offsetCounts = NULL;
+    profile->offsetCapacity = 0;
+    profile->spotCount = 0;
+    profile->spotCapacity = PROFILE_SPOTS_CAPACITY;
+    profile->spots = ALLOCATE(MEM_DIAGNOSTICS, ProfileSpot, PROFILE_SPOTS_CAPACITY);
+    for (int32_t i = 0; i < profile->spotCapacity; ++i) {
+        profile->spots[i].opcode = -1;
+    }
+#ifdef PROFILE_CYCLES
+    profile->tick = 0;
+    profile->sampledOpcode = -1;
+    profile->sampleStart = 0;
+#endif
+}
+
+void freeProfile(Profile* profile) {
+    FREE_ARRAY(MEM_DIAGNOSTICS, uint64_t, profile->offsetCounts, profile->offsetCapacity);
+    FREE_ARRAY(MEM_DIAGNOSTICS, ProfileSpot, profile->spots, profile->spotCapacity);
+    profile->offsetCounts = NULL;
+    profile->spots = NULL;
+}
+
+static uint32_t spotHash(int32_t line, int32_t opcode) {
+    uint32_t hash = (uint32_t)line * 2654435761u;
+    return hash ^ ((uint32_t)opcode * 40503u);
+}
+
+static ProfileSpot* findSpot(ProfileSpot* spots, int32_t capacity, int32_t line,
+                             int32_t opcode) {
+    uint32_t index = spotHash(line, opcode) & (uint32_t)(capacity - 1);
+    for (;;) {
+        ProfileSpot* spot = &spots[index];
+        if (spot->opcode == -1 || (spot->line == line && spot->opcode == opcode)) {
+            return spot;
+        }
+        index = (index + 1) & (uint32_t)(capacity - 1);
+    }
+}
+
+static void growSpots(Profile* profile) {
+    int32_t capacity = profile->spotCapacity * 2;
+    ProfileSpot* spots = ALLOCATE(MEM_DIAGNOSTICS, ProfileSpot, capacity);
+    for (int32_t i = 0; i < capacity; ++i) {
+        spots[i].opcode = -1;
+    }
+
+    for (int32_t i = 0; i < profile->spotCapacity; ++i) {
+        ProfileSpot* spot = &profile->spots[i];
+        if (spot->opcode != -1) {
+            *findSpot(spots, capacity, spot->line, spot->opcode) = *spot;
+        }
+    }
+
+    FREE_ARRAY(MEM_DIAGNOSTICS, ProfileSpot, profile->spots, profile->spotCapacity);
+    profile->spots = spots;
+    profile->spotCapacity = capacity;
+}
+
+static void addSpot(Profile* profile, int32_t line, uint8_t opcode, int32_t offset,
+                    uint64_t count) {
+    if (profile->spotCount + 1 > profile->spotCapacity * 3 / 4) {
+        growSpots(profile);
+    }
+
+    ProfileSpot* spot = findSpot(profile->spots, profile->spotCapacity, line, opcode);
+    if (spot->opcode == -1) {
+        *spot = (ProfileSpot){line, opcode, offset, 0};
+        profile->spotCount++;
+    }
+    spot->count += count;
+}
+
+// zeroed counters for every offset of the chunk about to run
+void profileBeginChunk(Profile* profile, Chunk* chunk) {
+    if (profile->offsetCapacity < chunk->count) {
+        profile->offsetCounts = GROW_ARRAY(MEM_DIAGNOSTICS, uint64_t, profile->offsetCounts,
+                                           profile->offsetCapacity, chunk->count);
+        profile->offsetCapacity = chunk->count;
+    }
+    memset(profile->offsetCounts, 0, sizeof(uint64_t) * chunk->count);
+#ifdef PROFILE_CYCLES
+    profile->sampledOpcode = -1;
+#endif
+}
+
+// Folds the offset counters into (line, opcode) spots while the chunk and
+// its line table are still alive; the chunk is often freed before exit.
+// A quickened offset is filed under the opcode it ended up as.
+void profileEndChunk(Profile* profile, Chunk* chunk) {
+#ifdef PROFILE_CYCLES
+    // the last instruction returned or failed, there is no next dispatch
+    profile->sampledOpcode = -1;
+#endif
+    int32_t run = 0;
+    int32_t runEnd = chunk->lineCount > 0 ? chunk->lines[0].count : 0;
+
+    for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk->data[offset])) {
+        while (offset >= runEnd && run + 1 < chunk->lineCount) {
+            run++;
+            runEnd += chunk->lines[run].count;
+        }
+        if (profile->offsetCounts[offset] == 0) {
+            continue;
+        }
+
+        int32_t line = chunk->lineCount > 0 ? chunk->lines[run].line : -1;
+        addSpot(profile, line, chunk->data[offset], offset, profile->offsetCounts[offset]);
+    }
+}
+
+static int compareSpots(const void* a, const void* b) {
+    const ProfileSpot* x = (const ProfileSpot*)a;
+    const ProfileSpot* y = (const ProfileSpot*)b;
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return x->line != y->line ? x->line - y->line : x->opcode - y->opcode;
+}
+
+typedef struct {
+    int opcode;
+    uint64_t count;
+} OpcodeTotal;
+
+static int compareOpcodeTotals(const void* a, const void* b) {
+    const OpcodeTotal* x = (const OpcodeTotal*)a;
+    const OpcodeTotal* y = (const OpcodeTotal*)b;
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return x->opcode - y->opcode;
+}
+
+void dumpProfile(Profile* profile, FILE* out) {
+    uint64_t total = 0;
+    OpcodeTotal opcodes[OPCODE_COUNT];
+    int opcodeCount = 0;
+    for (int i = 0; i < OPCODE_COUNT; ++i) {
+        total += profile->opcodeCounts[i];
+        if (profile->opcodeCounts[i] > 0) {
+            opcodes[opcodeCount++] = (OpcodeTotal){i, profile->opcodeCounts[i]};
+        }
+    }
+    if (total == 0) {
+        return;
+    }
+
+    qsort(opcodes, opcodeCount, sizeof(OpcodeTotal), compareOpcodeTotals);
+
+    fprintf(out, "== profile: %llu instructions ==\n", (unsigned long long)total);
+#ifdef PROFILE_CYCLES
+    fprintf(out, "%14s %7s %12s  %s\n", "count", "%", "cycles/op", "opcode");
+#else
+    fprintf(out, "%14s %7s  %s\n", "count", "%", "opcode");
+#endif
+    for (int i = 0; i < opcodeCount; ++i) {
+        int op = opcodes[i].opcode;
+        double share = 100.0 * (double)profile->opcodeCounts[op] / (double)total;
+#ifdef PROFILE_CYCLES
+        double cycles = profile->opcodeSamples[op] > 0
+                            ? (double)profile->opcodeCycles[op] / (double)profile->opcodeSamples[op]
+                            : 0.0;
+        fprintf(out, "%14llu %6.2f%% %12.1f  %s\n", (unsigned long long)profile->opcodeCounts[op],
+                share, cycles, opcodeName((uint8_t)op));
+#else
+        fprintf(out, "%14llu %6.2f%%  %s\n", (unsigned long long)profile->opcodeCounts[op], share,
+                opcodeName((uint8_t)op));
+#endif
+    }
+
+    ProfileSpot* spots = ALLOCATE(MEM_DIAGNOSTICS, ProfileSpot, profile->spotCount + 1);
+    int32_t spotCount = 0;
+    for (int32_t i = 0; i < profile->spotCapacity; ++i) {
+        if (profile->spots[i].opcode != -1) {
+            spots[spotCount++] = profile->spots[i];
+        }
+    }
+    qsort(spots, spotCount, sizeof(ProfileSpot), compareSpots);
+
+    fprintf(out, "\n== profile: hot spots ==\n");
+    fprintf(out, "%14s %7s %6s %8s  %s\n", "count", "%", "line", "offset", "opcode");
+    for (int32_t i = 0; i < spotCount && i < PROFILE_TOP_SPOTS; ++i) {
+        fprintf(out, "%14llu %6.2f%% %6d %8d  %s\n", (unsigned long long)spots[i].count,
+                100.0 * (double)spots[i].count / (double)total, spots[i].line, spots[i].offset,
+                opcodeName((uint8_t)spots[i].opcode));
+    }
+    FREE_ARRAY(MEM_DIAGNOSTICS, ProfileSpot, spots, profile->spotCount + 1);
+}
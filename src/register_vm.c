@@ -0,0 +1,469 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "chunk.h"
+#include "debug.h"
+#include "orion_memory.h"
+#include "register_vm.h"
+#include "value.h"
+#include "vm.h"
+
+#define REGISTER_CHUNK_CAPACITY 16
+
+static void emitRegisterInstruction(RegisterChunk* code, uint8_t op, uint16_t dst,
+                                    uint32_t b, uint32_t c, int offset) {
+    if (code->count == code->capacity) {
+        int32_t oldCapacity = code->capacity;
+        code->capacity *= 2;
+        code->code = GROW_ARRAY(MEM_REGISTER_CODE, RegisterInstruction, code->code,
+                                oldCapacity, code->capacity);
+        code->offsets = GROW_ARRAY(MEM_REGISTER_CODE, int32_t, code->offsets,
+                                   oldCapacity, code->capacity);
+    }
+
+    code->code[code->count] = (RegisterInstruction){op, dst, b, c};
+    code->offsets[code->count] = offset;
+    code->count++;
+}
+
+static uint32_t immediateOperand(RegisterChunk* code, Value value) {
+    pushValueArrEl(&code->immediates, value);
+    return MAKE_OPERAND(OPERAND_IMMEDIATE, code->immediates.count - 1);
+}
+
+// moves every constant still pending on the simulated stack into its
+// register, so all paths into a jump target agree on where values live
+static void flushSlots(RegisterChunk* code, uint32_t* slots, int depth, int offset) {
+    for (int i = 0; i < depth; ++i) {
+        uint32_t reg = MAKE_OPERAND(OPERAND_REGISTER, i);
+        if (slots[i] != reg) {
+            emitRegisterInstruction(code, REG_MOVE, (uint16_t)i, slots[i], 0, offset);
+            slots[i] = reg;
+        }
+    }
+}
+
+static uint8_t registerOpFor(uint8_t opcode) {
+    switch (opcode) {
+        case OP_JUMP: return REG_JUMP;
+        case OP_JUMP_IF_FALSE: return REG_JUMP_IF_FALSE;
+        case OP_JUMP_IF_TRUE: return REG_JUMP_IF_TRUE;
+        case OP_NOT: return REG_NOT;
+        case OP_TO_BOOL: return REG_TO_BOOL;
+        case OP_NEGATE: return REG_NEGATE;
+        case OP_XOR: return REG_XOR;
+        case OP_EQUAL:
+        case OP_EQUAL_NUM: return REG_EQUAL;
+        case OP_NOT_EQUAL:
+        case OP_NOT_EQUAL_NUM: return REG_NOT_EQUAL;
+        case OP_GREATER:
+        case OP_GREATER_NUM:
+        case OP_GREATER_CONST:
+        case OP_GREATER_IMM: return REG_GREATER;
+        case OP_LESS:
+        case OP_LESS_NUM:
+        case OP_LESS_CONST:
+        case OP_LESS_IMM: return REG_LESS;
+        case OP_GREATER_EQUAL:
+        case OP_GREATER_EQUAL_NUM:
+        case OP_GREATER_EQUAL_CONST:
+        case OP_GREATER_EQUAL_IMM: return REG_GREATER_EQUAL;
+        case OP_LESS_EQUAL:
+        case OP_LESS_EQUAL_NUM:
+        case OP_LESS_EQUAL_CONST:
+        case OP_LESS_EQUAL_IMM: return REG_LESS_EQUAL;
+        case OP_ADD:
+        case OP_ADD_NUM:
+        case OP_ADD_CONST:
+        case OP_ADD_IMM:
+        case OP_INC: return REG_ADD;
+        case OP_SUB:
+        case OP_SUB_NUM:
+        case OP_SUB_CONST:
+        case OP_SUB_IMM:
+        case OP_DEC: return REG_SUB;
+        case OP_MULT:
+        case OP_MULT_NUM:
+        case OP_MULT_CONST:
+        case OP_MULT_IMM: return REG_MULT;
+        case OP_DIV:
+        case OP_DIV_NUM:
+        case OP_DIV_CONST:
+        case OP_DIV_IMM: return REG_DIV;
+        default: return REG_RET;
+    }
+}
+
+// Translates the stack code by simulating the stack symbolically: each slot
+// holds the operand its value can be read from, and only operators write
+// registers. Returns NULL when the chunk needs more registers than an
+// instruction can name; the caller then runs the stack code instead. The
+// register code is counted as the chunk's, whichever VM asked for it.
+RegisterChunk* lowerToRegisters(Chunk* chunk) {
+    if (chunk->maxStackDepth > UINT16_MAX) {
+        return NULL;
+    }
+
+    MemoryStats* previous = useMemoryStats(&chunk->memory);
+    RegisterChunk* code = ALLOCATE(MEM_REGISTER_CODE, RegisterChunk, 1);
+    code->count = 0;
+    code->capacity = REGISTER_CHUNK_CAPACITY;
+    code->code = ALLOCATE(MEM_REGISTER_CODE, RegisterInstruction, code->capacity);
+    code->offsets = ALLOCATE(MEM_REGISTER_CODE, int32_t, code->capacity);
+    initValueArr(&code->immediates, NULL);
+    code->registerCount = chunk->maxStackDepth;
+
+    uint32_t* slots = ALLOCATE(MEM_COMPILER, uint32_t, chunk->maxStackDepth + 1);
+    // stack depth on arrival at each jump target, -1 for the rest
+    int32_t* targetDepth = ALLOCATE(MEM_COMPILER, int32_t, chunk->count + 1);
+    // stack code offset -> register instruction index
+    int32_t* newIndex = ALLOCATE(MEM_COMPILER, int32_t, chunk->count + 1);
+    for (int i = 0; i <= chunk->count; ++i) {
+        targetDepth[i] = -1;
+    }
+
+    int depth = 0;
+    bool reachable = true;
+
+    for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk->data[offset])) {
+        uint8_t opcode = chunk->data[offset];
+        uint8_t* operand = chunk->data + offset + 1;
+
+        if (targetDepth[offset] >= 0) {
+            if (reachable) {
+                flushSlots(code, slots, depth, offset);
+            }
+            depth = targetDepth[offset];
+            for (int i = 0; i < depth; ++i) {
+                slots[i] = MAKE_OPERAND(OPERAND_REGISTER, i);
+            }
+            reachable = true;
+        }
+        newIndex[offset] = code->count;
+
+        switch (opcode) {
+            case OP_CONSTANT:
+                slots[depth++] = MAKE_OPERAND(OPERAND_CONSTANT, operand[0]);
+                break;
+            case OP_CONSTANT_LONG:
+                slots[depth++] = MAKE_OPERAND(OPERAND_CONSTANT,
+                                              (operand[0] << 16) | (operand[1] << 8) | operand[2]);
+                break;
+            case OP_ZERO:
+                slots[depth++] = immediateOperand(code, NUMBER_VAL(0));
+                break;
+            case OP_ONE:
+                slots[depth++] = immediateOperand(code, NUMBER_VAL(1));
+                break;
+            case OP_PUSH_I8:
+                slots[depth++] = immediateOperand(code, NUMBER_VAL((int8_t)operand[0]));
+                break;
+            case OP_PUSH_I16:
+                slots[depth++] = immediateOperand(
+                    code, NUMBER_VAL((int16_t)((operand[0] << 8) | operand[1])));
+                break;
+            case OP_GET_INPUT:
+                slots[depth++] = MAKE_OPERAND(OPERAND_INPUT, operand[0]);
+                break;
+            case OP_TRUE:
+                slots[depth++] = immediateOperand(code, BOOL_VAL(true));
+                break;
+            case OP_FALSE:
+                slots[depth++] = immediateOperand(code, BOOL_VAL(false));
+                break;
+            case OP_NIL:
+                slots[depth++] = immediateOperand(code, NIL_VAL);
+                break;
+            case OP_POP:
+                depth--;
+                break;
+            case OP_JUMP:
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_TRUE: {
+                flushSlots(code, slots, depth, offset);
+                int target = offset + 3 + ((operand[0] << 8) | operand[1]);
+                targetDepth[target] = depth;
+                // patched to an instruction index once the target is lowered
+                uint32_t condition = MAKE_OPERAND(OPERAND_REGISTER, depth > 0 ? depth - 1 : 0);
+                emitRegisterInstruction(code, registerOpFor(opcode), 0, (uint32_t)target,
+                                        condition, offset);
+                reachable = opcode != OP_JUMP;
+                break;
+            }
+            case OP_NOT:
+            case OP_TO_BOOL:
+            case OP_NEGATE:
+                emitRegisterInstruction(code, registerOpFor(opcode), (uint16_t)(depth - 1),
+                                        slots[depth - 1], 0, offset);
+                slots[depth - 1] = MAKE_OPERAND(OPERAND_REGISTER, depth - 1);
+                break;
+            case OP_INC:
+            case OP_DEC:
+                emitRegisterInstruction(code, registerOpFor(opcode), (uint16_t)(depth - 1),
+                                        slots[depth - 1], immediateOperand(code, NUMBER_VAL(1)),
+                                        offset);
+                slots[depth - 1] = MAKE_OPERAND(OPERAND_REGISTER, depth - 1);
+                break;
+            case OP_ADD_CONST:
+            case OP_SUB_CONST:
+            case OP_MULT_CONST:
+            case OP_DIV_CONST:
+            case OP_GREATER_CONST:
+            case OP_LESS_CONST:
+            case OP_GREATER_EQUAL_CONST:
+            case OP_LESS_EQUAL_CONST:
+                emitRegisterInstruction(code, registerOpFor(opcode), (uint16_t)(depth - 1),
+                                        slots[depth - 1],
+                                        MAKE_OPERAND(OPERAND_CONSTANT, operand[0]), offset);
+                slots[depth - 1] = MAKE_OPERAND(OPERAND_REGISTER, depth - 1);
+                break;
+            case OP_ADD_IMM:
+            case OP_SUB_IMM:
+            case OP_MULT_IMM:
+            case OP_DIV_IMM:
+            case OP_GREATER_IMM:
+            case OP_LESS_IMM:
+            case OP_GREATER_EQUAL_IMM:
+            case OP_LESS_EQUAL_IMM:
+                emitRegisterInstruction(code, registerOpFor(opcode), (uint16_t)(depth - 1),
+                                        slots[depth - 1],
+                                        immediateOperand(code, NUMBER_VAL((int8_t)operand[0])),
+                                        offset);
+                slots[depth - 1] = MAKE_OPERAND(OPERAND_REGISTER, depth - 1);
+                break;
+            case OP_RET:
+                emitRegisterInstruction(code, REG_RET, 0, slots[depth - 1], 0, offset);
+                depth--;
+                reachable = false;
+                break;
+            default:
+                // binary operators
+                emitRegisterInstruction(code, registerOpFor(opcode), (uint16_t)(depth - 2),
+                                        slots[depth - 2], slots[depth - 1], offset);
+                depth--;
+                slots[depth - 1] = MAKE_OPERAND(OPERAND_REGISTER, depth - 1);
+                break;
+        }
+    }
+    newIndex[chunk->count] = code->count;
+
+    for (int i = 0; i < code->count; ++i) {
+        uint8_t op = code->code[i].op;
+        if (op == REG_JUMP || op == REG_JUMP_IF_FALSE || op == REG_JUMP_IF_TRUE) {
+            code->code[i].b = (uint32_t)newIndex[code->code[i].b];
+        }
+    }
+
+    FREE_ARRAY(MEM_COMPILER, uint32_t, slots, chunk->maxStackDepth + 1);
+    FREE_ARRAY(MEM_COMPILER, int32_t, targetDepth, chunk->count + 1);
+    FREE_ARRAY(MEM_COMPILER, int32_t, newIndex, chunk->count + 1);
+
+#ifdef DEBUG
+    disassembleRegisterChunk(code, chunk, "registers");
+#endif
+
+    useMemoryStats(previous);
+    return code;
+}
+
+void freeRegisterChunk(RegisterChunk* code) {
+    FREE_ARRAY(MEM_REGISTER_CODE, RegisterInstruction, code->code, code->capacity);
+    FREE_ARRAY(MEM_REGISTER_CODE, int32_t, code->offsets, code->capacity);
+    freeValueArr(&code->immediates);
+    FREE(MEM_REGISTER_CODE, RegisterChunk, code);
+}
+
+// Same semantics and errors as run(), over registers. The registers are the
+// VM's stack slots, so the two backends share their storage too.
+InterpretResult runRegisters(VM* vm, RegisterChunk* code) {
+    reserveStack(&vm->stack, (uint32_t)code->registerCount);
+    Value* registers = vm->stack.data;
+    // indexed by operand kind
+    const Value* pools[] = {registers, vm->chunk->constants.data, code->immediates.data,
+                            vm->inputs};
+    RegisterInstruction* ip = code->code;
+    RegisterInstruction* instruction;
+
+#define OPERAND(operand) \
+    (pools[(operand) >> OPERAND_KIND_SHIFT][(operand) & OPERAND_INDEX_MASK])
+
+// runtimeError reports the line of vm->ip, so point it at the stack code
+// this instruction came from
+#define REGISTER_ERROR(message)                                             \
+    do {                                                                    \
+        vm->ip = vm->chunk->data + code->offsets[instruction - code->code] + 1; \
+        runtimeError(vm, message);                                          \
+        return INTERPRET_RUNTIME_ERROR;                                     \
+    } while (false)
+
+#define BINARY_OP(RESULT_VAL, op)                                           \
+    do {                                                                    \
+        Value a = OPERAND(instruction->b);                                  \
+        Value b = OPERAND(instruction->c);                                  \
+        if (!IS_NUMBER(a) || !IS_NUMBER(b)) {                               \
+            REGISTER_ERROR("Operands must be numbers.");                    \
+        }                                                                   \
+        registers[instruction->dst] = RESULT_VAL(AS_NUMBER(a) op AS_NUMBER(b)); \
+    } while (false)
+
+#ifdef DEBUG
+#define TRACE_INSTRUCTION() \
+    disassembleRegisterInstruction(code, vm->chunk, (int)(ip - code->code))
+#else
+#define TRACE_INSTRUCTION() do { } while (false)
+#endif
+
+#ifdef COUNT_INSTRUCTIONS
+#define COUNT_INSTRUCTION() (vm->instructionCount++)
+#else
+#define COUNT_INSTRUCTION() do { } while (false)
+#endif
+
+#ifdef COMPUTED_GOTO
+    static void* dispatchTable[] = {
+        [REG_RET]           = &&CASE_REG_RET,
+        [REG_MOVE]          = &&CASE_REG_MOVE,
+        [REG_JUMP]          = &&CASE_REG_JUMP,
+        [REG_JUMP_IF_FALSE] = &&CASE_REG_JUMP_IF_FALSE,
+        [REG_JUMP_IF_TRUE]  = &&CASE_REG_JUMP_IF_TRUE,
+        [REG_NOT]           = &&CASE_REG_NOT,
+        [REG_TO_BOOL]       = &&CASE_REG_TO_BOOL,
+        [REG_NEGATE]        = &&CASE_REG_NEGATE,
+        [REG_XOR]           = &&CASE_REG_XOR,
+        [REG_EQUAL]         = &&CASE_REG_EQUAL,
+        [REG_NOT_EQUAL]     = &&CASE_REG_NOT_EQUAL,
+        [REG_GREATER]       = &&CASE_REG_GREATER,
+        [REG_LESS]          = &&CASE_REG_LESS,
+        [REG_GREATER_EQUAL] = &&CASE_REG_GREATER_EQUAL,
+        [REG_LESS_EQUAL]    = &&CASE_REG_LESS_EQUAL,
+        [REG_ADD]           = &&CASE_REG_ADD,
+        [REG_SUB]           = &&CASE_REG_SUB,
+        [REG_MULT]          = &&CASE_REG_MULT,
+        [REG_DIV]           = &&CASE_REG_DIV,
+    };
+
+#define DISPATCH()                                  \
+    do {                                            \
+        TRACE_INSTRUCTION();                        \
+        COUNT_INSTRUCTION();                        \
+        instruction = ip++;                         \
+        goto *dispatchTable[instruction->op];       \
+    } while (false)
+#define VM_CASE(op) CASE_##op:
+#define VM_BREAK DISPATCH()
+#else
+#define VM_CASE(op) case op:
+#define VM_BREAK break
+#endif
+
+#ifdef COMPUTED_GOTO
+    DISPATCH();
+#else
+    for (;;) {
+        TRACE_INSTRUCTION();
+        COUNT_INSTRUCTION();
+        instruction = ip++;
+        switch (instruction->op) {
+#endif
+            VM_CASE(REG_RET) {
+                vm->result = OPERAND(instruction->b);
+                return INTERPRET_OK;
+            }
+            VM_CASE(REG_MOVE) {
+                registers[instruction->dst] = OPERAND(instruction->b);
+                VM_BREAK;
+            }
+            VM_CASE(REG_JUMP) {
+                ip = code->code + instruction->b;
+                VM_BREAK;
+            }
+            VM_CASE(REG_JUMP_IF_FALSE) {
+                if (isFalseyValue(OPERAND(instruction->c))) {
+                    ip = code->code + instruction->b;
+                }
+                VM_BREAK;
+            }
+            VM_CASE(REG_JUMP_IF_TRUE) {
+                if (!isFalseyValue(OPERAND(instruction->c))) {
+                    ip = code->code + instruction->b;
+                }
+                VM_BREAK;
+            }
+            VM_CASE(REG_NOT) {
+                registers[instruction->dst] = BOOL_VAL(isFalseyValue(OPERAND(instruction->b)));
+                VM_BREAK;
+            }
+            VM_CASE(REG_TO_BOOL) {
+                registers[instruction->dst] = BOOL_VAL(toBool(OPERAND(instruction->b)));
+                VM_BREAK;
+            }
+            VM_CASE(REG_NEGATE) {
+                Value value = OPERAND(instruction->b);
+                if (!IS_NUMBER(value)) {
+                    REGISTER_ERROR("Operand must be a number.");
+                }
+                registers[instruction->dst] = NUMBER_VAL(-AS_NUMBER(value));
+                VM_BREAK;
+            }
+            VM_CASE(REG_XOR) {
+                registers[instruction->dst] = BOOL_VAL(toBool(OPERAND(instruction->b))
+                                                       ^ toBool(OPERAND(instruction->c)));
+                VM_BREAK;
+            }
+            VM_CASE(REG_EQUAL) {
+                registers[instruction->dst] =
+                    BOOL_VAL(areValuesEqual(OPERAND(instruction->b), OPERAND(instruction->c)));
+                VM_BREAK;
+            }
+            VM_CASE(REG_NOT_EQUAL) {
+                registers[instruction->dst] =
+                    BOOL_VAL(!areValuesEqual(OPERAND(instruction->b), OPERAND(instruction->c)));
+                VM_BREAK;
+            }
+            VM_CASE(REG_GREATER) {
+                BINARY_OP(BOOL_VAL, >);
+                VM_BREAK;
+            }
+            VM_CASE(REG_LESS) {
+                BINARY_OP(BOOL_VAL, <);
+                VM_BREAK;
+            }
+            VM_CASE(REG_GREATER_EQUAL) {
+                BINARY_OP(BOOL_VAL, >=);
+                VM_BREAK;
+            }
+            VM_CASE(REG_LESS_EQUAL) {
+                BINARY_OP(BOOL_VAL, <=);
+                VM_BREAK;
+            }
+            VM_CASE(REG_ADD) {
+                BINARY_OP(NUMBER_VAL, +);
+                VM_BREAK;
+            }
+            VM_CASE(REG_SUB) {
+                BINARY_OP(NUMBER_VAL, -);
+                VM_BREAK;
+            }
+            VM_CASE(REG_MULT) {
+                BINARY_OP(NUMBER_VAL, *);
+                VM_BREAK;
+            }
+            VM_CASE(REG_DIV) {
+                BINARY_OP(NUMBER_VAL, /);
+                VM_BREAK;
+            }
+#ifndef COMPUTED_GOTO
+        }
+    }
+#endif
+
+#undef OPERAND
+#undef REGISTER_ERROR
+#undef BINARY_OP
+#undef TRACE_INSTRUCTION
+#undef COUNT_INSTRUCTION
+#undef DISPATCH
+#undef VM_CASE
+#undef VM_BREAK
+}
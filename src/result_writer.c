@@ -0,0 +1,357 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "orion_memory.h"
+#include "result_writer.h"
+#include "value.h"
+
+// The general case is Schubfach (R. Giulietti, "The Schubfach way to render
+// doubles"): with v = c 2^q, scale the rounding interval of v by 10^-k so
+// that it holds one or two numbers of the form s 10^k with s of 16 or 17
+// digits, pick the shortest of those and, on a tie, the closest to v. g is
+// a 126-bit approximation of 10^-k from above, split into two 63-bit halves
+// like the paper does, and obeys (g - 1) 2^r <= 10^-k < g 2^r.
+#define Q_MIN (-1074)
+#define K_MIN (-324)
+#define K_MAX 292
+#define C_MIN (1ull << 52)
+// subnormals below this many ulps are scaled up by 10 first, as in the paper
+#define C_TINY 3
+#define MASK_63 ((1ull << 63) - 1)
+// the powers are worked out once, from 2^POWER_BITS / 10^n for 10^-n
+#define POWER_BITS 1100
+#define POWER_LIMBS 18
+
+typedef unsigned __int128 uint128;
+
+static uint64_t powers[K_MAX - K_MIN + 1][2];
+static pthread_once_t powersOnce = PTHREAD_ONCE_INIT;
+
+// floor(e log10(2)), floor(e log10(3/4 2^e)) and floor(e log2(10))
+static int flog10pow2(int e) {
+    return (int)((int64_t)e * 661971961083 >> 41);
+}
+
+static int flog10threeQuartersPow2(int e) {
+    return (int)(((int64_t)e * 661971961083 - 274743187321) >> 41);
+}
+
+static int flog2pow10(int e) {
+    return (int)((int64_t)e * 913124641741 >> 38);
+}
+
+static void multiplyLimbs(uint64_t* limbs, uint64_t by) {
+    uint64_t carry = 0;
+    for (int i = 0; i < POWER_LIMBS; ++i) {
+        uint128 product = (uint128)limbs[i] * by + carry;
+        limbs[i] = (uint64_t)product;
+        carry = (uint64_t)(product >> 64);
+    }
+}
+
+static void divideLimbs(uint64_t* limbs, uint64_t by) {
+    uint64_t remainder = 0;
+    for (int i = POWER_LIMBS - 1; i >= 0; --i) {
+        uint128 dividend = ((uint128)remainder << 64) | limbs[i];
+        limbs[i] = (uint64_t)(dividend / by);
+        remainder = (uint64_t)(dividend % by);
+    }
+}
+
+// the 128 bits of limbs from bit `shift` up, or shifted left if negative
+static uint128 limbBits(const uint64_t* limbs, int shift) {
+    if (shift < 0) {
+        return (((uint128)limbs[1] << 64) | limbs[0]) << -shift;
+    }
+    uint128 bits = 0;
+    for (int i = 0; i < 128; i += 64) {
+        int bit = shift + i;
+        int limb = bit / 64;
+        int offset = bit % 64;
+        uint64_t word = limb < POWER_LIMBS ? limbs[limb] >> offset : 0;
+        if (offset > 0 && limb + 1 < POWER_LIMBS) {
+            word |= limbs[limb + 1] << (64 - offset);
+        }
+        bits |= (uint128)word << i;
+    }
+    return bits;
+}
+
+static void storePower(int k, uint128 g) {
+    g += 1;
+    powers[k - K_MIN][0] = (uint64_t)(g >> 63);
+    powers[k - K_MIN][1] = (uint64_t)g & MASK_63;
+}
+
+// g = floor(10^-k 2^(125 - flog2pow10(-k))) + 1
+static void computePowers(void) {
+    uint64_t limbs[POWER_LIMBS] = {1};
+    for (int n = 0; n <= -K_MIN; ++n) {
+        storePower(-n, limbBits(limbs, flog2pow10(n) - 125));
+        multiplyLimbs(limbs, 10);
+    }
+
+    // floor(floor(x / 10) / 10) is floor(x / 100), so every 10^-n comes
+    // out of the one big power of two, exactly
+    memset(limbs, 0, sizeof(limbs));
+    limbs[POWER_BITS / 64] = 1ull << (POWER_BITS % 64);
+    for (int n = 1; n <= K_MAX; ++n) {
+        divideLimbs(limbs, 10);
+        storePower(n, limbBits(limbs, POWER_BITS - 125 + flog2pow10(-n)));
+    }
+}
+
+static uint64_t multiplyHigh(uint64_t a, uint64_t b) {
+    return (uint64_t)(((uint128)a * b) >> 64);
+}
+
+// cp g 2^-127, rounded to odd
+static uint64_t roundOdd(uint64_t g1, uint64_t g0, uint64_t cp) {
+    uint64_t x1 = multiplyHigh(g0, cp);
+    uint64_t y0 = g1 * cp;
+    uint64_t y1 = multiplyHigh(g1, cp);
+    uint64_t z = (y0 >> 1) + x1;
+    uint64_t vbp = y1 + (z >> 63);
+    return vbp | (((z & MASK_63) + MASK_63) >> 63);
+}
+
+// The shortest decimal f 10^e in the rounding interval of c 2^q, scaled
+// by 10^dk beforehand.
+static void toDecimal(int q, uint64_t c, int dk, uint64_t* f, int* e) {
+    uint64_t out = c & 1;
+    uint64_t cb = c << 2;
+    uint64_t cbr = cb + 2;
+    uint64_t cbl;
+    int k;
+    // the interval below a power of two is half as wide
+    if (c != C_MIN || q == Q_MIN) {
+        cbl = cb - 2;
+        k = flog10pow2(q);
+    } else {
+        cbl = cb - 1;
+        k = flog10threeQuartersPow2(q);
+    }
+    int h = q + flog2pow10(-k) + 2;
+
+    uint64_t g1 = powers[k - K_MIN][0];
+    uint64_t g0 = powers[k - K_MIN][1];
+    uint64_t vb = roundOdd(g1, g0, cb << h);
+    uint64_t vbl = roundOdd(g1, g0, cbl << h);
+    uint64_t vbr = roundOdd(g1, g0, cbr << h);
+
+    uint64_t s = vb >> 2;
+    if (s >= 100) {
+        // one digit fewer, if either neighbour is in the interval
+        uint64_t sp10 = s / 10 * 10;
+        uint64_t tp10 = sp10 + 10;
+        bool upin = vbl + out <= sp10 << 2;
+        bool wpin = (tp10 << 2) + out <= vbr;
+        if (upin != wpin) {
+            *f = upin ? sp10 : tp10;
+            *e = k;
+            return;
+        }
+    }
+
+    uint64_t t = s + 1;
+    bool uin = vbl + out <= s << 2;
+    bool win = (t << 2) + out <= vbr;
+    *e = k + dk;
+    if (uin != win) {
+        *f = uin ? s : t;
+        return;
+    }
+    // both in, round to nearest and to even between the two
+    int64_t cmp = (int64_t)(vb - ((s + t) << 1));
+    *f = cmp < 0 || (cmp == 0 && (s & 1) == 0) ? s : t;
+}
+
+// f 10^e like %g would, but with every digit of f: fixed notation for
+// decimal exponents in [-5, 16), 1.5e+300 style outside it
+static int writeDecimal(char* text, uint64_t f, int e) {
+    while (f % 10 == 0) {
+        f /= 10;
+        e++;
+    }
+    char digits[24];
+    int count = 0;
+    for (; f > 0; f /= 10) {
+        digits[count++] = (char)('0' + f % 10);
+    }
+    int exponent = count + e - 1;
+
+    int length = 0;
+    if (exponent < -5 || exponent >= 16) {
+        text[length++] = digits[count - 1];
+        if (count > 1) {
+            text[length++] = '.';
+            for (int i = count - 2; i >= 0; --i) {
+                text[length++] = digits[i];
+            }
+        }
+        text[length++] = 'e';
+        text[length++] = exponent < 0 ? '-' : '+';
+        int magnitude = exponent < 0 ? -exponent : exponent;
+        if (magnitude >= 100) {
+            text[length++] = (char)('0' + magnitude / 100);
+        }
+        text[length++] = (char)('0' + magnitude / 10 % 10);
+        text[length++] = (char)('0' + magnitude % 10);
+        text[length] = '\0';
+        return length;
+    }
+
+    if (exponent < 0) {
+        text[length++] = '0';
+        text[length++] = '.';
+        for (int i = exponent + 1; i < 0; ++i) {
+            text[length++] = '0';
+        }
+    }
+    for (int i = count - 1; i >= 0; --i) {
+        text[length++] = digits[i];
+        if (i == count - 1 - exponent && i > 0) {
+            text[length++] = '.';
+        }
+    }
+    for (int i = 0; i < e; ++i) {
+        text[length++] = '0';
+    }
+    text[length] = '\0';
+    return length;
+}
+
+void initResultWriter(ResultWriter* writer, int fd) {
+    writer->fd = fd;
+    writer->buffer = ALLOCATE(MEM_STRINGS, char, RESULT_BUFFER_SIZE);
+    writer->used = 0;
+    writer->failed = false;
+}
+
+// flushes what is left, false if any write failed
+bool freeResultWriter(ResultWriter* writer) {
+    bool written = flushResultWriter(writer);
+    FREE_ARRAY(MEM_STRINGS, char, writer->buffer, RESULT_BUFFER_SIZE);
+    writer->buffer = NULL;
+    return written;
+}
+
+// Writes the shortest text strtod reads back as value, NUL-terminated,
+// and returns its length (at most VALUE_TEXT_MAX - 1).
+int formatNumber(double value, char* text) {
+    if (isnan(value)) {
+        memcpy(text, "nan", 4);
+        return 3;
+    }
+
+    int sign = 0;
+    if (signbit(value)) {
+        text[sign++] = '-';
+        value = -value;
+    }
+    if (isinf(value)) {
+        memcpy(text + sign, "inf", 4);
+        return sign + 3;
+    }
+
+    if (value == 0) {
+        memcpy(text + sign, "0", 2);
+        return sign + 1;
+    }
+
+    pthread_once(&powersOnce, computePowers);
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t t = bits & (C_MIN - 1);
+    int bq = (int)(bits >> 52);
+    uint64_t f;
+    int e;
+    if (bq != 0) {
+        int q = bq - 1075;
+        uint64_t c = C_MIN | t;
+        if (q <= 0 && q > -53 && (c & ((1ull << -q) - 1)) == 0) {
+            // an integer below 2^53, which needs no search
+            f = c >> -q;
+            e = 0;
+        } else {
+            toDecimal(q, c, 0, &f, &e);
+        }
+    } else if (t < C_TINY) {
+        toDecimal(Q_MIN, 10 * t, -1, &f, &e);
+        // that gives 4.9e-324 and 9.9e-324, which read back just as well
+        // as 5e-324 and 1e-323
+        f = (f + 5) / 10;
+        e++;
+    } else {
+        toDecimal(Q_MIN, t, 0, &f, &e);
+    }
+    return sign + writeDecimal(text + sign, f, e);
+}
+
+// the same text printValue gives bools and nil, numbers as formatNumber
+int formatValue(Value value, char* text) {
+    if (IS_BOOL(value)) {
+        const char* name = AS_BOOL(value) ? "true" : "false";
+        int length = (int)strlen(name);
+        memcpy(text, name, length + 1);
+        return length;
+    }
+    if (IS_NIL(value)) {
+        memcpy(text, "nil", 4);
+        return 3;
+    }
+    return formatNumber(AS_NUMBER(value), text);
+}
+
+// one result per line
+void writeResult(ResultWriter* writer, Value value) {
+    if (writer->used + VALUE_TEXT_MAX + 1 > RESULT_BUFFER_SIZE) {
+        flushResultWriter(writer);
+    }
+
+    char* line = writer->buffer + writer->used;
+    int length = formatValue(value, line);
+    line[length] = '\n';
+    writer->used += (size_t)length + 1;
+}
+
+// A whole batch of results, e.g. EvalBatch.results, with a single flush
+// at the end rather than one per line.
+bool writeResults(ResultWriter* writer, const Value* values, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        writeResult(writer, values[i]);
+    }
+    return flushResultWriter(writer);
+}
+
+bool flushResultWriter(ResultWriter* writer) {
+    // whatever went through stdio before has to come out first
+    if (writer->fd == STDOUT_FILENO) {
+        fflush(stdout);
+    }
+
+    const char* data = writer->buffer;
+    size_t left = writer->failed ? 0 : writer->used;
+    while (left > 0) {
+        ssize_t written = write(writer->fd, data, left);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            writer->failed = true;
+            break;
+        }
+        data += written;
+        left -= (size_t)written;
+    }
+
+    writer->used = 0;
+    return !writer->failed;
+}
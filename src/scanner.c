@@ -1,69 +1,103 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "bytecode_cache.h"
+#include "chunk_cache.h"
 #include "common.h"
+#include "compiler.h"
+#include "orion_memory.h"
 #include "scanner.h"
+#include "scanner_simd.h"
 #include "vm.h"
 
-Scanner scanner;
+Token scanToken(Scanner* scanner) {
+    if (scanner->stream != NULL) {
+        return scanStreamToken(scanner);
+    }
+
+    skipWhitespaceAndComments(scanner);
+    return scanTokenAt(scanner);
+}
+
+// scans the lexeme again when the length wasn't kept
+int tokenLength(const Token* token) {
+    if (token->length != TOKEN_LENGTH_UNKNOWN) {
+        return token->length;
+    }
+
+    Scanner scanner;
+    initScanner(&scanner, token->start);
+    return scanTokenAt(&scanner).length;
+}
 
-Token scanToken() {
-    skipWhitespaceAndComments();
-    scanner.start = scanner.current;
+// the token at current, whitespace and comments already skipped
+Token scanTokenAt(Scanner* scanner) {
+    scanner->start = scanner->current;
 
-    if (isAtEnd()) return makeToken(TOKEN_EOF);
+    if (isAtEnd(scanner)) return makeToken(scanner, TOKEN_EOF);
 
-    char c = advanceScanner();
-    if (isAlpha(c)) {
-        return scanIdentifier();
+    char c = advanceScanner(scanner);
+    uint8_t classes = charClasses[(uint8_t)c];
+    if (classes & CHAR_ALPHA) {
+        return scanIdentifier(scanner);
     }
-    if (isDigit(c)) {
-        return scanNumber();
+    if (classes & CHAR_DIGIT) {
+        return scanNumber(scanner);
     }
 
     switch (c) {
         case '(':
-            return makeToken(TOKEN_LEFT_PAREN);
+            return makeToken(scanner, TOKEN_LEFT_PAREN);
         case ')':
-            return makeToken(TOKEN_RIGHT_PAREN);
+            return makeToken(scanner, TOKEN_RIGHT_PAREN);
         case '{':
-            return makeToken(TOKEN_LEFT_BRACE);
+            return makeToken(scanner, TOKEN_LEFT_BRACE);
         case '}':
-            return makeToken(TOKEN_RIGHT_BRACE);
+            return makeToken(scanner, TOKEN_RIGHT_BRACE);
         case ';':
-            return makeToken(TOKEN_SEMICOLON);
+            return makeToken(scanner, TOKEN_SEMICOLON);
         case ',':
-            return makeToken(TOKEN_COMMA);
+            return makeToken(scanner, TOKEN_COMMA);
         case '.':
-            return makeToken(TOKEN_DOT);
+            return makeToken(scanner, TOKEN_DOT);
         case '-':
-            return makeToken(TOKEN_MINUS);
+            return makeToken(scanner, TOKEN_MINUS);
         case '+':
-            return makeToken(TOKEN_PLUS);
+            return makeToken(scanner, TOKEN_PLUS);
         case '/':
-            return makeToken(TOKEN_SLASH);
+            return makeToken(scanner, TOKEN_SLASH);
         case '*':
-            return makeToken(TOKEN_STAR);
+            return makeToken(scanner, TOKEN_STAR);
         case '!':
-            return makeToken(match('=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
+            return makeToken(scanner, match(scanner, '=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
         case '=':
-            return makeToken(match('=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
+            return makeToken(scanner, match(scanner, '=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
         case '<':
-            return makeToken(match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
+            return makeToken(scanner, match(scanner, '=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
         case '>':
-            return makeToken(match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
+            return makeToken(scanner, match(scanner, '=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
         case '"':
-            return scanString();
+            return scanString(scanner);
         case '$':
-            return scanInterpolation();
+            return scanInterpolation(scanner);
     }
 
-    return errorToken("Unexpected character.");
+    return errorToken(scanner, "Unexpected character.");
 }
 
 void repl(VM* vm) {
     char line[1024];
+    // lines typed again (or recalled from history) skip the compiler
+    ChunkCache cache;
+    initChunkCache(&cache);
 
     for (;;) {
         printf("> ");
@@ -73,17 +107,77 @@ void repl(VM* vm) {
             break;
         }
 
-        interpretChunk(vm, line);
+        Chunk* chunk = getCachedChunk(&cache, line);
+        if (chunk != NULL) {
+            runChunk(vm, chunk);
+        }
+        // the answer has to be out before the next prompt
+        if (vm->output != NULL) {
+            flushResultWriter(vm->output);
+        }
+    }
+
+    freeChunkCache(&cache);
+}
+
+// Runs path from its .orc cache when that was compiled from the same
+// source, otherwise compiles and refreshes the cache. Returns the exit
+// status: 65 for a compile error, 70 for a runtime error.
+int runFile(VM* vm, const char* path) {
+    SourceFile source;
+    loadSource(path, &source);
+    uint64_t hash = hashSource(source.data, source.length);
+    char* cachePath = source.isRegularFile ? bytecodePath(path) : NULL;
+
+    Chunk* chunk = NULL;
+    if (cachePath != NULL) {
+        chunk = loadBytecodeFile(cachePath, hash, source.length);
     }
+    if (chunk == NULL) {
+        chunk = source.length >= PIPELINE_MIN_SOURCE ? compileLargeChunk(source.data)
+                                                     : compileChunk(source.data);
+        if (chunk != NULL && cachePath != NULL) {
+            writeBytecodeFile(cachePath, chunk, hash, source.length);
+        }
+    }
+    freeString(cachePath);
+    releaseSource(&source);
+
+    if (chunk == NULL) return 65;
+
+    InterpretResult result = runChunk(vm, chunk);
+    releaseChunk(chunk);
+
+    if (result == INTERPRET_COMPILE_ERROR) return 65;
+    if (result == INTERPRET_RUNTIME_ERROR) return 70;
+    return 0;
 }
 
-void runFile(VM* vm, const char* path) {
-    char* source = readFile(path);
-    InterpretResult result = interpretChunk(vm, source);
-    free(source);
+// --stream: compiles path ("-" for stdin) in one pass through a window of
+// STREAM_WINDOW_SIZE bytes. There is no .orc cache, checking it needs the
+// whole source hashed up front.
+int runStream(VM* vm, const char* path) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        return 74;
+    }
+
+    Chunk* chunk = ALLOCATE(MEM_CHUNK, Chunk, 1);
+    initChunk(chunk);
+    bool compiled = compileStream(fd, STREAM_WINDOW_SIZE, chunk, stderr);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    if (!compiled) {
+        releaseChunk(chunk);
+        return 65;
+    }
 
-    if (result == INTERPRET_COMPILE_ERROR) exit(65);
-    if (result == INTERPRET_RUNTIME_ERROR) exit(70);
+    InterpretResult result = runChunk(vm, chunk);
+    releaseChunk(chunk);
+    if (result == INTERPRET_RUNTIME_ERROR) return 70;
+    return 0;
 }
 
 char* readFile(const char* path) {
@@ -93,231 +187,439 @@ char* readFile(const char* path) {
         exit(74);
     }
 
-    fseek(file, 0L, SEEK_END);
-    size_t fileSize = ftell(file);
-    rewind(file);
-
-    char* buffer = (char*)malloc(fileSize + 1);
+    size_t length;
+    char* buffer = readStream(file, &length);
     if (buffer == NULL) {
-        fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
+        fprintf(stderr, "Could not read file \"%s\".\n", path);
         fclose(file);
         exit(74);
     }
 
-    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
-    if (bytesRead < fileSize) {
-        fprintf(stderr, "Could not read file \"%s\".\n", path);
-        fclose(file);
+    fclose(file);
+    return buffer;
+}
+
+// Reads until EOF into a growing heap buffer, so it also works on pipes
+// where the size is not known up front. Returns NULL on a read error.
+char* readStream(FILE* file, size_t* length) {
+    size_t capacity = 4096;
+    size_t count = 0;
+    char* buffer = ALLOCATE(MEM_STRINGS, char, capacity);
+
+    for (;;) {
+        count += fread(buffer + count, sizeof(char), capacity - count - 1, file);
+        if (count < capacity - 1) {
+            break;
+        }
+
+        buffer = GROW_ARRAY(MEM_STRINGS, char, buffer, capacity, capacity * 2);
+        capacity *= 2;
+    }
+
+    if (ferror(file)) {
+        FREE_ARRAY(MEM_STRINGS, char, buffer, capacity);
+        return NULL;
+    }
+
+    // trimmed to length + 1, which is what releaseSource frees
+    buffer = GROW_ARRAY(MEM_STRINGS, char, buffer, capacity, count + 1);
+    buffer[count] = '\0';
+    *length = count;
+    return buffer;
+}
+
+// Maps a regular file read-only behind a zero-filled guard page, so the
+// byte after the last one is always a NUL for isAtEnd() without copying
+// the file. The file mapping is placed over the front of an anonymous
+// reservation one page larger than the file.
+static bool mapSource(int fd, size_t size, SourceFile* source) {
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t reserved = ((size + pageSize - 1) / pageSize + 1) * pageSize;
+
+    void* region = mmap(NULL, reserved, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return false;
+    }
+
+    void* file = mmap(region, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (file == MAP_FAILED) {
+        munmap(region, reserved);
+        return false;
+    }
+
+    source->data = (const char*)region;
+    source->length = size;
+    source->mapping = region;
+    source->mappingSize = reserved;
+    return true;
+}
+
+// Exits like readFile() when the script can't be read.
+void loadSource(const char* path, SourceFile* source) {
+    if (!openSource(path, source, stderr)) {
         exit(74);
     }
+}
+
+// "-" reads stdin. On failure the reason goes to errors and false is
+// returned, so batch callers can carry on with the next file.
+bool openSource(const char* path, SourceFile* source, FILE* errors) {
+    source->mapping = NULL;
+    source->mappingSize = 0;
+    source->isRegularFile = false;
+
+    if (strcmp(path, "-") == 0) {
+        source->data = readStream(stdin, &source->length);
+        if (source->data == NULL) {
+            fprintf(errors, "Could not read stdin.\n");
+            return false;
+        }
+        return true;
+    }
 
-    buffer[bytesRead] = '\0';
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(errors, "Could not open file \"%s\".\n", path);
+        return false;
+    }
+
+    struct stat st;
+    bool isRegular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    source->isRegularFile = isRegular;
+
+    if (isRegular && st.st_size > 0 && mapSource(fd, (size_t)st.st_size, source)) {
+        close(fd);
+        return true;
+    }
+
+    FILE* file = fdopen(fd, "rb");
+    if (file == NULL) {
+        fprintf(errors, "Could not open file \"%s\".\n", path);
+        close(fd);
+        return false;
+    }
 
+    source->data = readStream(file, &source->length);
     fclose(file);
-    return buffer;
+    if (source->data == NULL) {
+        fprintf(errors, "Could not read file \"%s\".\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+void releaseSource(SourceFile* source) {
+    if (source->mapping != NULL) {
+        munmap(source->mapping, source->mappingSize);
+    } else {
+        FREE_ARRAY(MEM_STRINGS, char, (char*)source->data, source->length + 1);
+    }
+
+    source->data = NULL;
+    source->mapping = NULL;
+}
+
+void initScanner(Scanner* scanner, const char* source) {
+    scanner->start = source;
+    scanner->current = source;
+    scanner->line = 1;
+    scanner->stream = NULL;
 }
 
-void initScanner(const char* source) {
-    scanner.start = source;
-    scanner.current = source;
-    scanner.line = 1;
+void initStreamScanner(Scanner* scanner, SourceStream* stream, int fd, size_t windowSize) {
+    stream->fd = fd;
+    stream->windowSize = windowSize;
+    stream->capacity = 0;
+    stream->window = ALLOCATE(MEM_STRINGS, char, 1);
+    stream->window[0] = '\0';
+    stream->limit = stream->window;
+    stream->held = NULL;
+    stream->heldCapacity = 0;
+    stream->keepHeld = false;
+    stream->atEnd = false;
+    stream->failed = false;
+
+    initScanner(scanner, stream->window);
+    scanner->stream = stream;
 }
 
-bool isAtEnd() { return (*scanner.current) == '\0'; }
+// the descriptor belongs to the caller
+void freeSourceStream(SourceStream* stream) {
+    FREE_ARRAY(MEM_STRINGS, char, stream->window, stream->capacity + 1);
+    FREE_ARRAY(MEM_STRINGS, char, stream->held, stream->heldCapacity + 1);
+    stream->window = NULL;
+    stream->held = NULL;
+}
+
+// Moves the bytes from scanner->start on into a fresh window and reads
+// behind them until it is full or the input ends; start and current then
+// point at the front of the new window. The old window is kept as held
+// when it has the last token returned, otherwise freed.
+static void refillWindow(Scanner* scanner) {
+    SourceStream* stream = scanner->stream;
+    size_t kept = (size_t)(stream->limit - scanner->start);
+    size_t capacity = stream->windowSize;
+    if (capacity < kept * 2) {
+        capacity = kept * 2;
+    }
+
+    char* window = ALLOCATE(MEM_STRINGS, char, capacity + 1);
+    memcpy(window, scanner->start, kept);
+    size_t count = kept;
+    while (count < capacity) {
+        ssize_t got = read(stream->fd, window + count, capacity - count);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            stream->failed = got < 0;
+            stream->atEnd = true;
+            break;
+        }
+        count += (size_t)got;
+    }
+    window[count] = '\0';
+
+    if (stream->held == NULL) {
+        stream->held = stream->window;
+        stream->heldCapacity = stream->capacity;
+    } else {
+        FREE_ARRAY(MEM_STRINGS, char, stream->window, stream->capacity + 1);
+    }
+    stream->window = window;
+    stream->capacity = capacity;
+    stream->limit = window + count;
+    scanner->start = window;
+    scanner->current = window;
+}
 
-Token makeToken(TokenType tokenType) {
+// Like skipWhitespaceAndComments, but refills wherever the run reaches
+// the end of the window. Leaves at least one byte of lookahead behind
+// current unless the input has ended.
+static void skipStreamWhitespace(Scanner* scanner) {
+    SourceStream* stream = scanner->stream;
+    for (;;) {
+        scanner->current = skipWhitespaceRun(scanner->current, &scanner->line);
+        if (scanner->current + 1 >= stream->limit && !stream->atEnd) {
+            scanner->start = scanner->current;
+            refillWindow(scanner);
+            continue;
+        }
+        if (peek(scanner) != '/' || peekNext(scanner) != '/') {
+            return;
+        }
+
+        scanner->current = findLineEnd(scanner->current + 2);
+        while (scanner->current == stream->limit && !stream->atEnd) {
+            // nothing of the comment needs keeping
+            scanner->start = scanner->current;
+            refillWindow(scanner);
+            scanner->current = findLineEnd(scanner->current);
+        }
+    }
+}
+
+// A token that ends within a byte of the window's end may go on in the
+// input not read yet (an identifier, a string, "<" before "="), so it is
+// scanned again from its start after a refill.
+Token scanStreamToken(Scanner* scanner) {
+    SourceStream* stream = scanner->stream;
+    // the token before the last one: the parser has let go of it
+    if (!stream->keepHeld) {
+        FREE_ARRAY(MEM_STRINGS, char, stream->held, stream->heldCapacity + 1);
+        stream->held = NULL;
+    }
+
+    skipStreamWhitespace(scanner);
+    int line = scanner->line;
+    for (;;) {
+        Token token = scanTokenAt(scanner);
+        if (stream->atEnd || scanner->current + 1 < stream->limit) {
+            stream->keepHeld = token.type == TOKEN_ERROR;
+            return token;
+        }
+
+        scanner->current = scanner->start;
+        scanner->line = line;
+        refillWindow(scanner);
+    }
+}
+
+bool isAtEnd(Scanner* scanner) { return (*scanner->current) == '\0'; }
+
+Token makeToken(Scanner* scanner, TokenType tokenType) {
     Token token;
     token.type = tokenType;
-    token.start = scanner.start;
-    token.length = (int)(scanner.current - scanner.start);
-    token.line = scanner.line;
+    token.start = scanner->start;
+    token.length = (int)(scanner->current - scanner->start);
+    token.line = scanner->line;
 
     return token;
 }
 
-Token errorToken(const char* message) {
+Token errorToken(Scanner* scanner, const char* message) {
     Token token;
     token.type = TOKEN_ERROR;
     token.start = message;
     token.length = (int)strlen(message);
-    token.line = scanner.line;
+    token.line = scanner->line;
     return token;
 }
 
-char advanceScanner() {
-    scanner.current++;
-    return scanner.current[-1];
+char advanceScanner(Scanner* scanner) {
+    scanner->current++;
+    return scanner->current[-1];
 }
 
-bool match(char expected) {
-    if (isAtEnd()) return false;
-    if (*scanner.current != expected) return false;
+bool match(Scanner* scanner, char expected) {
+    if (isAtEnd(scanner)) return false;
+    if (*scanner->current != expected) return false;
 
-    scanner.current++;
+    scanner->current++;
     return true;
 }
 
-void skipWhitespaceAndComments() {
+// Whitespace runs and comment bodies are skipped a block at a time, see
+// scanner_simd.h.
+void skipWhitespaceAndComments(Scanner* scanner) {
     for (;;) {
-        char c = peek();
-        switch (c) {
-                // whitespace
-            case '\t':
-            case '\r':
-            case ' ':
-                advanceScanner();
-                break;
-            case '\n':
-                scanner.line++;
-                advanceScanner();
-                break;
-                // comments
-            case '/':
-                if (peekNext() == '/') {
-                    while (!isAtEnd() && peek() != '\n') {
-                        advanceScanner();
-                    }
-                }
-                else {
-                    return;
-                }
-                
-                break;
-            default:
-                return;
+        scanner->current = skipWhitespaceRun(scanner->current, &scanner->line);
+        if (peek(scanner) != '/' || peekNext(scanner) != '/') {
+            return;
         }
+        scanner->current = findLineEnd(scanner->current + 2);
     }
 }
 
-char peek() { return *scanner.current; }
-char peekNext() {
-    if (isAtEnd()) return '\0';
-    return scanner.current[1];
+char peek(Scanner* scanner) { return *scanner->current; }
+char peekNext(Scanner* scanner) {
+    if (isAtEnd(scanner)) return '\0';
+    return scanner->current[1];
 }
 
-Token scanString() {
-    while (peek() != '"' && !isAtEnd()) {
-        char c = advanceScanner();
-        if (c == '\n') {
-            scanner.line++;
-        }
-    }
+Token scanString(Scanner* scanner) {
+    scanner->current = findClosing(scanner->current, '"', &scanner->line);
 
-    if (isAtEnd()) {
-        return errorToken("Unterminated string");
+    if (isAtEnd(scanner)) {
+        return errorToken(scanner, "Unterminated string");
     }
 
-    advanceScanner();
-    return makeToken(TOKEN_STRING);
+    advanceScanner(scanner);
+    return makeToken(scanner, TOKEN_STRING);
 }
 
-Token scanNumber() {
-    while (isDigit(peek())) {
-        advanceScanner();
-    }
+Token scanNumber(Scanner* scanner) {
+    scanner->current = skipDigitRun(scanner->current);
 
-    if (peek() == '.' && isDigit(peekNext())) {
-        do {
-            advanceScanner();
-        } while (isDigit(peek()));
+    if (peek(scanner) == '.' && isDigit(peekNext(scanner))) {
+        scanner->current = skipDigitRun(scanner->current + 1);
     }
 
-    return makeToken(TOKEN_NUMBER);
+    return makeToken(scanner, TOKEN_NUMBER);
 }
 
-Token scanIdentifier() {
-    while (isAlpha(peek()) || isDigit(peek())) {
-        advanceScanner();
-    }
+Token scanIdentifier(Scanner* scanner) {
+    scanner->current = skipIdentifierRun(scanner->current);
 
-    return makeToken(identifierType());
+    return makeToken(scanner, identifierType(scanner));
 }
 
-TokenType identifierType() {
-    switch (scanner.start[0]) {
-        case 'a':
-            return checkKeyword(1, 2, "nd", TOKEN_AND);
-        case 'c':
-            return checkKeyword(1, 4, "lass", TOKEN_CLASS);
-        case 'e':
-            return checkKeyword(1, 3, "lse", TOKEN_ELSE);
-        case 'f':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'a':
-                        return checkKeyword(2, 3, "lse", TOKEN_FALSE);
-                    case 'o':
-                        return checkKeyword(2, 1, "r", TOKEN_FOR);
-                    case 'u':
-                        return checkKeyword(2, 1, "n", TOKEN_FUN);
-                }
-            }
-            break;
-        case 'i':
-            return checkKeyword(1, 1, "f", TOKEN_IF);
-        case 'n':
-            return checkKeyword(1, 2, "il", TOKEN_NIL);
-        case 'o':
-            return checkKeyword(1, 1, "r", TOKEN_OR);
-        case 'p':
-            return checkKeyword(1, 4, "rint", TOKEN_PRINT);
-        case 'r':
-            return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
-        case 's':
-            return checkKeyword(1, 4, "uper", TOKEN_SUPER);
-        case 't':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'h':
-                        return checkKeyword(2, 2, "is", TOKEN_THIS);
-                    case 'r':
-                        return checkKeyword(2, 2, "ue", TOKEN_TRUE);
-                }
-            }
-            break;
-        case 'v':
-            return checkKeyword(1, 2, "ar", TOKEN_VAR);
-        case 'x':
-            return checkKeyword(1, 2, "or", TOKEN_XOR);
-        case 'w':
-            return checkKeyword(1, 4, "hile", TOKEN_WHILE);
-        default:
-            return TOKEN_IDENTIFIER;
+// Keywords sit in a table indexed by a hash of their first and last
+// character and length, so an identifier costs one slot lookup and one
+// compare. The slots are computed by KEYWORD_SLOT at compile time; two
+// keywords landing on the same slot fail the build with -Woverride-init.
+#define KEYWORD_SLOTS 32
+#define KEYWORD_MAX_LENGTH 6
+#define KEYWORD_SLOT(first, last, length)                                                   \
+    (((unsigned)(uint8_t)(first) + (unsigned)(uint8_t)(last) * 7u + (unsigned)(length)) &     \
+     (KEYWORD_SLOTS - 1))
+
+typedef struct {
+    const char* name;
+    int length;         // 0 for an empty slot, which no identifier matches
+    TokenType type;
+} Keyword;
+
+#define KEYWORD(name, first, last, type) \
+    [KEYWORD_SLOT(first, last, sizeof(name) - 1)] = {name, sizeof(name) - 1, type}
+
+static const Keyword keywords[KEYWORD_SLOTS] = {
+    KEYWORD("and", 'a', 'd', TOKEN_AND),
+    KEYWORD("class", 'c', 's', TOKEN_CLASS),
+    KEYWORD("else", 'e', 'e', TOKEN_ELSE),
+    KEYWORD("false", 'f', 'e', TOKEN_FALSE),
+    KEYWORD("for", 'f', 'r', TOKEN_FOR),
+    KEYWORD("fun", 'f', 'n', TOKEN_FUN),
+    KEYWORD("if", 'i', 'f', TOKEN_IF),
+    KEYWORD("nil", 'n', 'l', TOKEN_NIL),
+    KEYWORD("or", 'o', 'r', TOKEN_OR),
+    KEYWORD("print", 'p', 't', TOKEN_PRINT),
+    KEYWORD("return", 'r', 'n', TOKEN_RETURN),
+    KEYWORD("super", 's', 'r', TOKEN_SUPER),
+    KEYWORD("this", 't', 's', TOKEN_THIS),
+    KEYWORD("true", 't', 'e', TOKEN_TRUE),
+    KEYWORD("var", 'v', 'r', TOKEN_VAR),
+    KEYWORD("while", 'w', 'e', TOKEN_WHILE),
+    KEYWORD("xor", 'x', 'r', TOKEN_XOR),
+};
+
+#undef KEYWORD
+
+TokenType identifierType(Scanner* scanner) {
+    int length = (int)(scanner->current - scanner->start);
+    if (length < 2 || length > KEYWORD_MAX_LENGTH) {
+        return TOKEN_IDENTIFIER;
     }
 
-    return TOKEN_IDENTIFIER;
+    const Keyword* keyword =
+        &keywords[KEYWORD_SLOT(scanner->start[0], scanner->start[length - 1], length)];
+    return checkKeyword(scanner, 0, keyword->length, keyword->name, keyword->type);
 }
 
-TokenType checkKeyword(int offset, int length, const char* rest,
-                       TokenType type) {
-    if ((scanner.current - scanner.start == offset + length) &&
-        memcmp(scanner.start + offset, rest, length) == 0) {
+TokenType checkKeyword(Scanner* scanner, int offset, int length,
+                       const char* rest, TokenType type) {
+    if ((scanner->current - scanner->start == offset + length) &&
+        memcmp(scanner->start + offset, rest, length) == 0) {
         return type;
     }
 
     return TOKEN_IDENTIFIER;
 }
 
-Token scanInterpolation() {
-    if (peek() != '{') {
-        return errorToken("Unfinished interpolation syntax");
+Token scanInterpolation(Scanner* scanner) {
+    if (peek(scanner) != '{') {
+        return errorToken(scanner, "Unfinished interpolation syntax");
     }
 
-    while (peek() != '}' && !isAtEnd()) {
-        char c = advanceScanner();
-        if (c == '\n') {
-            scanner.line++;
-        }
-    }
+    scanner->current = findClosing(scanner->current, '}', &scanner->line);
 
-    if (isAtEnd()) {
-        return errorToken("Unterminated interpolation");
+    if (isAtEnd(scanner)) {
+        return errorToken(scanner, "Unterminated interpolation");
     }
 
-    return makeToken(TOKEN_INTERPOLATION);
+    return makeToken(scanner, TOKEN_INTERPOLATION);
 }
 
-bool isDigit(char c) { return c >= '0' && c <= '9'; }
-bool isAlpha(char c) {
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
-}
+#define A CHAR_ALPHA
+#define D CHAR_DIGIT
+#define S CHAR_SPACE
+
+const uint8_t charClasses[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, S, S, 0, 0, S, 0, 0, // 0x00 '\t' '\n' '\r'
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x10
+    S, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x20 ' '
+    D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0, // 0x30 0-9
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A, // 0x40 A-O
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, A, // 0x50 P-Z '_'
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A, // 0x60 a-o
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0, // 0x70 p-z
+    // 0x80-0xff: nothing, non-ASCII bytes are not part of any token
+};
+
+#undef A
+#undef D
+#undef S
+
+bool isDigit(char c) { return hasCharClass(c, CHAR_DIGIT); }
+bool isAlpha(char c) { return hasCharClass(c, CHAR_ALPHA); }
@@ -0,0 +1,114 @@
+#include <string.h>
+
+#include "orion_memory.h"
+#include "token_buffer.h"
+
+#define TOKEN_BUFFER_INITIAL_CAPACITY 256
+
+void initTokenBuffer(TokenBuffer* tokens) {
+    tokens->source = NULL;
+    tokens->types = NULL;
+    tokens->offsets = NULL;
+    tokens->count = 0;
+    tokens->capacity = 0;
+    tokens->lines = NULL;
+    tokens->lineCount = 0;
+    tokens->lineCapacity = 0;
+    tokens->messages = NULL;
+    tokens->messageCount = 0;
+    tokens->messageCapacity = 0;
+}
+
+void freeTokenBuffer(TokenBuffer* tokens) {
+    FREE_ARRAY(MEM_COMPILER, uint8_t, tokens->types, tokens->capacity);
+    FREE_ARRAY(MEM_COMPILER, uint32_t, tokens->offsets, tokens->capacity);
+    FREE_ARRAY(MEM_COMPILER, LineRun, tokens->lines, tokens->lineCapacity);
+    FREE_ARRAY(MEM_COMPILER, const char*, tokens->messages, tokens->messageCapacity);
+    initTokenBuffer(tokens);
+}
+
+static uint32_t pushMessage(TokenBuffer* tokens, const char* message) {
+    if (tokens->messageCount == tokens->messageCapacity) {
+        uint32_t capacity = tokens->messageCapacity == 0 ? 8 : tokens->messageCapacity * 2;
+        tokens->messages = GROW_ARRAY(MEM_COMPILER, const char*, tokens->messages,
+                                      tokens->messageCapacity, capacity);
+        tokens->messageCapacity = capacity;
+    }
+
+    tokens->messages[tokens->messageCount] = message;
+    return tokens->messageCount++;
+}
+
+void pushToken(TokenBuffer* tokens, Token token) {
+    if (tokens->count == tokens->capacity) {
+        uint32_t capacity =
+            tokens->capacity == 0 ? TOKEN_BUFFER_INITIAL_CAPACITY : tokens->capacity * 2;
+        tokens->types = GROW_ARRAY(MEM_COMPILER, uint8_t, tokens->types, tokens->capacity,
+                                   capacity);
+        tokens->offsets = GROW_ARRAY(MEM_COMPILER, uint32_t, tokens->offsets, tokens->capacity,
+                                     capacity);
+        tokens->capacity = capacity;
+    }
+
+    tokens->types[tokens->count] = (uint8_t)token.type;
+    tokens->offsets[tokens->count] = token.type == TOKEN_ERROR
+                                         ? pushMessage(tokens, token.start)
+                                         : (uint32_t)(token.start - tokens->source);
+    tokens->count++;
+
+    if (tokens->lineCount > 0 && tokens->lines[tokens->lineCount - 1].line == token.line) {
+        tokens->lines[tokens->lineCount - 1].count++;
+        return;
+    }
+    if (tokens->lineCount == tokens->lineCapacity) {
+        int32_t capacity = tokens->lineCapacity == 0 ? 16 : tokens->lineCapacity * 2;
+        tokens->lines = GROW_ARRAY(MEM_COMPILER, LineRun, tokens->lines, tokens->lineCapacity,
+                                   capacity);
+        tokens->lineCapacity = capacity;
+    }
+    tokens->lines[tokens->lineCount++] = (LineRun){token.line, 1};
+}
+
+// scans source up to and including its EOF token
+void lexTokens(TokenBuffer* tokens, const char* source) {
+    Scanner scanner;
+    initScanner(&scanner, source);
+    tokens->source = source;
+
+    for (;;) {
+        Token token = scanToken(&scanner);
+        pushToken(tokens, token);
+        if (token.type == TOKEN_EOF) {
+            return;
+        }
+    }
+}
+
+void initTokenCursor(TokenCursor* cursor, TokenBuffer* tokens) {
+    cursor->next = 0;
+    cursor->run = 0;
+    cursor->runEnd = tokens->lineCount > 0 ? (uint32_t)tokens->lines[0].count : 0;
+}
+
+Token readToken(TokenBuffer* tokens, TokenCursor* cursor) {
+    uint32_t index = cursor->next;
+    if (index + 1 < tokens->count) {
+        cursor->next++;
+    }
+    while (index >= cursor->runEnd && cursor->run + 1 < tokens->lineCount) {
+        cursor->run++;
+        cursor->runEnd += (uint32_t)tokens->lines[cursor->run].count;
+    }
+
+    Token token;
+    token.type = (TokenType)tokens->types[index];
+    token.line = tokens->lines[cursor->run].line;
+    if (token.type == TOKEN_ERROR) {
+        token.start = tokens->messages[tokens->offsets[index]];
+        token.length = (int)strlen(token.start);
+    } else {
+        token.start = tokens->source + tokens->offsets[index];
+        token.length = TOKEN_LENGTH_UNKNOWN;
+    }
+    return token;
+}
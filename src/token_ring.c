@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "orion_memory.h"
+#include "token_ring.h"
+
+// true once the EOF token is in
+static bool fillBlock(TokenBlock* block, Scanner* scanner, const char* source) {
+    block->count = 0;
+    block->errorCount = 0;
+    while (block->count < TOKEN_BLOCK_SIZE && block->errorCount < TOKEN_BLOCK_ERRORS) {
+        Token token = scanToken(scanner);
+        uint32_t index = block->count++;
+        block->types[index] = (uint8_t)token.type;
+        block->lines[index] = token.line;
+        if (token.type == TOKEN_ERROR) {
+            block->errors[block->errorCount] = token.start;
+            block->offsets[index] = block->errorCount++;
+        } else {
+            block->offsets[index] = (uint32_t)(token.start - source);
+        }
+        if (token.type == TOKEN_NUMBER) {
+            block->numbers[index] = strtod(token.start, NULL);
+        }
+
+        if (token.type == TOKEN_EOF) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void* produceTokens(void* argument) {
+    TokenRing* ring = (TokenRing*)argument;
+    Scanner scanner;
+    initScanner(&scanner, ring->source);
+
+    for (uint32_t produced = 0;; ++produced) {
+        // wait for the consumer to free a slot
+        while (produced - atomic_load_explicit(&ring->consumed, memory_order_acquire)
+               == TOKEN_RING_BLOCKS) {
+            if (atomic_load_explicit(&ring->cancelled, memory_order_relaxed)) {
+                return NULL;
+            }
+            sched_yield();
+        }
+
+        TokenBlock* block = &ring->blocks[produced % TOKEN_RING_BLOCKS];
+        bool done = fillBlock(block, &scanner, ring->source);
+        atomic_store_explicit(&ring->produced, produced + 1, memory_order_release);
+        if (done) {
+            return NULL;
+        }
+    }
+}
+
+// False when there is no second core to lex on, the source is too big for
+// 32-bit offsets or the thread can't be started; the caller then compiles
+// on its own.
+bool startTokenRing(TokenRing* ring, const char* source) {
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2 || strlen(source) > UINT32_MAX) {
+        return false;
+    }
+
+    ring->source = source;
+    ring->blocks = ALLOCATE(MEM_COMPILER, TokenBlock, TOKEN_RING_BLOCKS);
+    atomic_init(&ring->produced, 0);
+    atomic_init(&ring->consumed, 0);
+    atomic_init(&ring->cancelled, false);
+    ring->block = NULL;
+    ring->next = 0;
+
+    if (pthread_create(&ring->producer, NULL, produceTokens, ring) != 0) {
+        FREE_ARRAY(MEM_COMPILER, TokenBlock, ring->blocks, TOKEN_RING_BLOCKS);
+        return false;
+    }
+    return true;
+}
+
+void stopTokenRing(TokenRing* ring) {
+    atomic_store_explicit(&ring->cancelled, true, memory_order_relaxed);
+    pthread_join(ring->producer, NULL);
+    FREE_ARRAY(MEM_COMPILER, TokenBlock, ring->blocks, TOKEN_RING_BLOCKS);
+    ring->blocks = NULL;
+}
+
+Token readRingToken(TokenRing* ring, double* number) {
+    uint32_t consumed = atomic_load_explicit(&ring->consumed, memory_order_relaxed);
+    if (ring->block != NULL && ring->next == ring->block->count) {
+        atomic_store_explicit(&ring->consumed, ++consumed, memory_order_release);
+        ring->block = NULL;
+    }
+    if (ring->block == NULL) {
+        while (atomic_load_explicit(&ring->produced, memory_order_acquire) == consumed) {
+            sched_yield();
+        }
+        ring->block = &ring->blocks[consumed % TOKEN_RING_BLOCKS];
+        ring->next = 0;
+    }
+
+    TokenBlock* block = ring->block;
+    uint32_t index = ring->next;
+    Token token;
+    token.type = (TokenType)block->types[index];
+    token.line = block->lines[index];
+    if (token.type == TOKEN_ERROR) {
+        token.start = block->errors[block->offsets[index]];
+        token.length = (int)strlen(token.start);
+    } else {
+        token.start = ring->source + block->offsets[index];
+        token.length = TOKEN_LENGTH_UNKNOWN;
+    }
+    if (token.type == TOKEN_NUMBER) {
+        *number = block->numbers[index];
+    }
+    // the EOF token is the last one produced, stay on it
+    if (token.type != TOKEN_EOF) {
+        ring->next++;
+    }
+    return token;
+}
@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode_cache.h"
+#include "chunk.h"
+#include "chunk_cache.h"
+#include "debug.h"
+#include "orion_memory.h"
+#include "trace.h"
+#include "value.h"
+#include "vm.h"
+
+_Static_assert((TRACE_CAPACITY & (TRACE_CAPACITY - 1)) == 0,
+               "TRACE_CAPACITY must be a power of two");
+_Static_assert(sizeof(TraceRecord) == 24, "TraceRecord must not have padding");
+
+void initTrace(TraceBuffer* trace) {
+    trace->records = ALLOCATE(MEM_DIAGNOSTICS, TraceRecord, TRACE_CAPACITY);
+    memset(trace->records, 0, sizeof(TraceRecord) * TRACE_CAPACITY);
+    trace->count = 0;
+}
+
+void freeTrace(TraceBuffer* trace) {
+    FREE_ARRAY(MEM_DIAGNOSTICS, TraceRecord, trace->records, TRACE_CAPACITY);
+    trace->records = NULL;
+    trace->count = 0;
+}
+
+void resetTrace(TraceBuffer* trace) {
+    trace->count = 0;
+}
+
+// Writes the records oldest first to path and the chunk to path's .orc.
+// The image is keyed by a hash of the code rather than of a source, so the
+// decoder refuses an image left behind by another dump.
+bool dumpTrace(TraceBuffer* trace, Chunk* chunk, const char* path) {
+    if (trace->count == 0) {
+        return false;
+    }
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.valueSize = sizeof(Value);
+    header.flags = orcFlags();
+    header.recordCount = trace->count < TRACE_CAPACITY ? (uint32_t)trace->count : TRACE_CAPACITY;
+    header.instructionCount = trace->count;
+    header.codeHash = hashSource((const char*)chunk->data, (size_t)chunk->count);
+    header.codeLength = (uint64_t)chunk->count;
+
+    char* imagePath = bytecodePath(path);
+    bool written = writeBytecodeFile(imagePath, chunk, header.codeHash, header.codeLength);
+    freeString(imagePath);
+    if (!written) {
+        return false;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t first = trace->count - header.recordCount;
+    for (uint64_t i = first; ok && i < trace->count; ++i) {
+        ok = fwrite(&trace->records[i & (TRACE_CAPACITY - 1)], sizeof(TraceRecord), 1, file) == 1;
+    }
+
+    return fclose(file) == 0 && ok;
+}
+
+static Value recordTop(TraceRecord* record) {
+#ifdef NAN_BOXING
+    return (Value)record->top;
+#else
+    switch (record->topType) {
+        case VAL_BOOL: return BOOL_VAL(record->top != 0);
+        case VAL_NUMBER: {
+            double number;
+            memcpy(&number, &record->top, sizeof(number));
+            return NUMBER_VAL(number);
+        }
+        default: return NIL_VAL;
+    }
+#endif
+}
+
+static bool readHeader(FILE* file, const char* path, TraceHeader* header) {
+    if (fread(header, sizeof(*header), 1, file) != 1 || header->magic != TRACE_MAGIC) {
+        fprintf(stderr, "\"%s\" is not a trace file.\n", path);
+        return false;
+    }
+    if (header->version != TRACE_VERSION || header->valueSize != sizeof(Value)
+        || header->flags != orcFlags()) {
+        fprintf(stderr, "\"%s\" was written by an incompatible build.\n", path);
+        return false;
+    }
+    return true;
+}
+
+// prints every record with the disassembly of the instruction it ran,
+// returns the exit status for main
+int decodeTrace(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        return 74;
+    }
+
+    TraceHeader header;
+    if (!readHeader(file, path, &header)) {
+        fclose(file);
+        return 65;
+    }
+
+    char* imagePath = bytecodePath(path);
+    Chunk* chunk = loadBytecodeFile(imagePath, header.codeHash, header.codeLength);
+    if (chunk == NULL) {
+        fprintf(stderr, "Missing or stale chunk image \"%s\".\n", imagePath);
+        freeString(imagePath);
+        fclose(file);
+        return 65;
+    }
+    freeString(imagePath);
+
+    printf("== trace: last %u of %llu instructions ==\n", header.recordCount,
+           (unsigned long long)header.instructionCount);
+
+    int status = 0;
+    uint64_t first = header.instructionCount - header.recordCount;
+    for (uint32_t i = 0; i < header.recordCount; ++i) {
+        TraceRecord record;
+        if (fread(&record, sizeof(record), 1, file) != 1 || record.offset >= (uint32_t)chunk->count) {
+            fprintf(stderr, "Truncated or corrupt trace \"%s\".\n", path);
+            status = 65;
+            break;
+        }
+
+        printf("%8llu %4u [ ", (unsigned long long)(first + i), record.depth);
+        printValue(recordTop(&record));
+        printf(" ] ");
+        if (record.opcode != chunk->data[record.offset]) {
+            printf("(ran as %s) ", opcodeName(record.opcode));
+        }
+        disassembleInstruction(chunk, (int)record.offset);
+    }
+
+    releaseChunk(chunk);
+    fclose(file);
+    return status;
+}
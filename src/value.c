@@ -1,23 +1,25 @@
 #include <common.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 #include "orion_memory.h"
 #include "value.h"
 
-void initValueArr(ValueArr* valueArr) {
+void initValueArr(ValueArr* valueArr, Arena* arena) {
     valueArr->count = 0;
     valueArr->capacity = DEFAULT_VALUE_ARR_CAPACITY;
-    valueArr->data = (Value*)malloc(sizeof(Value) * DEFAULT_VALUE_ARR_CAPACITY);
+    valueArr->arena = arena;
+    valueArr->data =
+        ARENA_GROW_ARRAY(arena, MEM_CONSTANTS, Value, NULL, 0, DEFAULT_VALUE_ARR_CAPACITY);
 }
 
 void pushValueArrEl(ValueArr* valueArr, Value new_el) {
-    assert(!isValueArrFull(valueArr) && "ValueArr is full.");
-
-    if (valueArr->count == valueArr->capacity) {
-        assert((valueArr->capacity * 2 <= UINT8_MAX) && "ValueArr can't grow more.");
+    if (isValueArrFull(valueArr)) {
+        uint32_t oldCapacity = valueArr->capacity;
         valueArr->capacity *= 2;
-        valueArr->data = GROW_ARRAY(Value, valueArr->data, valueArr->capacity);
+        valueArr->data = ARENA_GROW_ARRAY(valueArr->arena, MEM_CONSTANTS, Value, valueArr->data,
+                                          oldCapacity, valueArr->capacity);
     }
 
     valueArr->data[valueArr->count] = new_el;
@@ -35,20 +37,20 @@ Value popValueArrEl(ValueArr* valueArr) {
 
 void freeValueArr(ValueArr* valueArr) {
     if (valueArr->data != NULL) {
-        free(valueArr->data);
+        ARENA_FREE_ARRAY(valueArr->arena, MEM_CONSTANTS, Value, valueArr->data, valueArr->capacity);
         valueArr->data = NULL;
     }
 }
 
 void printValueArr(ValueArr* valueArr) {
-    for (int i = 0; i < valueArr->count; ++i) {
+    for (uint32_t i = 0; i < valueArr->count; ++i) {
         printf("%lf ", AS_NUMBER(valueArr->data[i]));
     }
     printf("\n");
 }
 
 bool isValueArrFull(ValueArr* valueArr) {
-    return valueArr->count == UINT8_MAX;
+    return valueArr->count == valueArr->capacity;
 }
 
 bool isFalseyValue(Value value) {
@@ -61,6 +63,13 @@ bool toBool(Value val) {
 }
 
 bool areValuesEqual(Value a, Value b) {
+#ifdef NAN_BOXING
+    // numbers still compare as doubles so NaN != NaN and -0 == 0
+    if (IS_NUMBER(a) && IS_NUMBER(b)) {
+        return AS_NUMBER(a) == AS_NUMBER(b);
+    }
+    return a == b;
+#else
     if (a.type != b.type) {
         return false;
     }
@@ -70,4 +79,158 @@ bool areValuesEqual(Value a, Value b) {
         case VAL_BOOL: return AS_BOOL(a) == AS_BOOL(b);
         case VAL_NIL: return true;
     }
+
+    return false;
+#endif
+}
+
+// same type and same bits, unlike areValuesEqual which follows == on doubles
+bool areValuesIdentical(Value a, Value b) {
+#ifdef NAN_BOXING
+    return a == b;
+#else
+    return a.type == b.type && valueBits(a) == valueBits(b);
+#endif
+}
+
+uint64_t valueBits(Value value) {
+#ifdef NAN_BOXING
+    return value;
+#else
+    uint64_t bits = 0;
+    if (IS_NUMBER(value)) {
+        memcpy(&bits, &value.as.number, sizeof(bits));
+    } else if (IS_BOOL(value)) {
+        bits = AS_BOOL(value);
+    }
+    return bits;
+#endif
+}
+
+void printValue(Value value) {
+    if (IS_BOOL(value)) {
+        printf("%s", AS_BOOL(value) ? "true" : "false");
+    } else if (IS_NIL(value)) {
+        printf("nil");
+    } else if (IS_NUMBER(value)) {
+        printf("%lf", AS_NUMBER(value));
+    } else {
+        printf("unrecognized");
+    }
+}
+
+// constant dedup table
+static uint32_t hashValueBits(Value value) {
+    // splitmix64 finalizer, spreads the mantissa bits of small integers
+    uint64_t x = valueBits(value);
+#ifndef NAN_BOXING
+    x ^= (uint64_t)value.type << 56;
+#endif
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (uint32_t)x;
+}
+
+void initValueTable(ValueTable* table, Arena* arena) {
+    table->count = 0;
+    table->capacity = 0;
+    table->entries = NULL;
+    table->arena = arena;
+}
+
+void freeValueTable(ValueTable* table) {
+    ARENA_FREE_ARRAY(table->arena, MEM_CONSTANTS, ValueTableEntry, table->entries, table->capacity);
+    initValueTable(table, table->arena);
+}
+
+static ValueTableEntry* findValueTableEntry(ValueTableEntry* entries,
+                                            uint32_t capacity, Value key) {
+    uint32_t slot = hashValueBits(key) & (capacity - 1);
+
+    for (;;) {
+        ValueTableEntry* entry = &entries[slot];
+        if (entry->index == VALUE_TABLE_EMPTY || areValuesIdentical(entry->key, key)) {
+            return entry;
+        }
+
+        slot = (slot + 1) & (capacity - 1);
+    }
+}
+
+static void growValueTable(ValueTable* table) {
+    uint32_t capacity = table->capacity == 0 ? 16 : table->capacity * 2;
+    ValueTableEntry* entries =
+        ARENA_GROW_ARRAY(table->arena, MEM_CONSTANTS, ValueTableEntry, NULL, 0, capacity);
+    for (uint32_t i = 0; i < capacity; ++i) {
+        entries[i].index = VALUE_TABLE_EMPTY;
+    }
+
+    for (uint32_t i = 0; i < table->capacity; ++i) {
+        ValueTableEntry* entry = &table->entries[i];
+        if (entry->index == VALUE_TABLE_EMPTY) {
+            continue;
+        }
+
+        *findValueTableEntry(entries, capacity, entry->key) = *entry;
+    }
+
+    ARENA_FREE_ARRAY(table->arena, MEM_CONSTANTS, ValueTableEntry, table->entries, table->capacity);
+    table->entries = entries;
+    table->capacity = capacity;
+}
+
+// returns the ValueArr slot of key or -1
+int32_t valueTableGet(ValueTable* table, Value key) {
+    if (table->count == 0) {
+        return VALUE_TABLE_EMPTY;
+    }
+
+    ValueTableEntry* entry = findValueTableEntry(table->entries, table->capacity, key);
+    return entry->index < 0 ? VALUE_TABLE_EMPTY : entry->index;
+}
+
+void valueTableSet(ValueTable* table, Value key, int32_t index) {
+    if (table->count + 1 > table->capacity * VALUE_TABLE_MAX_LOAD) {
+        growValueTable(table);
+    }
+
+    ValueTableEntry* entry = findValueTableEntry(table->entries, table->capacity, key);
+    if (entry->index == VALUE_TABLE_EMPTY) {
+        table->count++;
+    }
+
+    entry->key = key;
+    entry->index = index;
+}
+
+// Backward-shift deletion: the entries probing past the freed slot move
+// up into it, so there are no tombstones and folding, which deletes every
+// constant it replaces, never grows the table.
+void valueTableDelete(ValueTable* table, Value key) {
+    if (table->count == 0) {
+        return;
+    }
+
+    ValueTableEntry* entries = table->entries;
+    uint32_t mask = table->capacity - 1;
+    ValueTableEntry* entry = findValueTableEntry(entries, table->capacity, key);
+    if (entry->index == VALUE_TABLE_EMPTY) {
+        return;
+    }
+
+    uint32_t hole = (uint32_t)(entry - entries);
+    for (uint32_t slot = (hole + 1) & mask; entries[slot].index != VALUE_TABLE_EMPTY;
+         slot = (slot + 1) & mask) {
+        // an entry can fill the hole unless its home slot lies after it
+        uint32_t home = hashValueBits(entries[slot].key) & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            entries[hole] = entries[slot];
+            hole = slot;
+        }
+    }
+    entries[hole].index = VALUE_TABLE_EMPTY;
+    table->count--;
 }
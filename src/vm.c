@@ -8,57 +8,231 @@
 #include "compiler.h"
 #include "debug.h"
 #include "orion_memory.h"
+#include "register_vm.h"
 #include "value.h"
 #include "vm.h"
 
-void initVM(VM* vm) { initStack(&vm->stack); }
+void initVM(VM* vm) {
+    initMemoryStats(&vm->memory);
+    MemoryStats* previous = useMemoryStats(&vm->memory);
+    initStack(&vm->stack);
+    vm->backend = BACKEND_STACK;
+    vm->result = NIL_VAL;
+    vm->output = NULL;
+    vm->inputs = NULL;
+    vm->diagnostics = stderr;
+    vm->quicken = true;
+#ifdef COUNT_INSTRUCTIONS
+    vm->instructionCount = 0;
+#endif
+#ifdef PROFILE
+    initProfile(&vm->profile);
+#endif
+#ifdef TRACE
+    initTrace(&vm->trace);
+#endif
+    useMemoryStats(previous);
+}
 
 void initStack(Stack* stack) {
     stack->capacity = STACK_DEF_CAP;
     stack->count = 0;
-    stack->data = malloc(sizeof(Value) * stack->capacity);
+    stack->data = ALLOCATE(MEM_STACK, Value, stack->capacity);
 }
 
 InterpretResult interpretChunk(VM* vm, const char* source) {
-    Chunk chunk;
-    initChunk(&chunk);
+    Chunk* chunk = compileChunk(source);
+    if (chunk == NULL) {
+        return INTERPRET_COMPILE_ERROR;
+    }
+
+    InterpretResult res = runChunk(vm, chunk);
+    releaseChunk(chunk);
+
+    return res;
+}
 
-    if (!compile(source, &chunk)) {
+static Chunk* newChunk(const char* source, bool pipelined) {
+    Chunk* chunk = ALLOCATE(MEM_CHUNK, Chunk, 1);
+    initChunk(chunk);
+
+    bool compiled = pipelined ? compilePipelined(source, chunk, stderr) : compile(source, chunk);
+    if (!compiled) {
 #ifdef DEBUG
-    printf("Compile error for source: %s\n", source);        
+        printf("Compile error for source: %s\n", source);
 #endif
-        return INTERPRET_COMPILE_ERROR;
+        releaseChunk(chunk);
+        return NULL;
     }
 
-    vm->chunk = &chunk;
-    vm->ip = vm->chunk->data;
+    return chunk;
+}
 
-    InterpretResult res = run(vm);
-    freeChunk(&chunk);
+// returns NULL on a compile error
+Chunk* compileChunk(const char* source) {
+    return newChunk(source, false);
+}
 
-    return res;
+// the same, lexing on a second thread
+Chunk* compileLargeChunk(const char* source) {
+    return newChunk(source, true);
+}
+
+InterpretResult runChunk(VM* vm, Chunk* chunk) {
+    InterpretResult result = executeChunk(vm, chunk);
+    if (result == INTERPRET_OK && vm->output != NULL) {
+        writeResult(vm->output, vm->result);
+    } else if (result == INTERPRET_OK) {
+        printValue(vm->result);
+        printf("\n");
+    }
+    return result;
+}
+
+static InterpretResult executeOnVM(VM* vm, Chunk* chunk) {
+    resetStack(&vm->stack);
+    vm->chunk = chunk;
+    vm->ip = chunk->data;
+#ifdef TRACE
+    resetTrace(&vm->trace);
+#endif
+
+    if (vm->backend == BACKEND_REGISTER) {
+        if (chunk->registerCode == NULL) {
+            chunk->registerCode = lowerToRegisters(chunk);
+        }
+        // chunks that can't be lowered still run on the stack
+        if (chunk->registerCode != NULL) {
+            return runRegisters(vm, chunk->registerCode);
+        }
+    }
+
+    reserveStack(&vm->stack, (uint32_t)chunk->maxStackDepth);
+#ifdef PROFILE
+    profileBeginChunk(&vm->profile, chunk);
+    InterpretResult result = run(vm);
+    profileEndChunk(&vm->profile, chunk);
+    return result;
+#else
+    return run(vm);
+#endif
+}
+
+// Only resets the stack: nothing is allocated per run once the stack has
+// grown to the chunk's depth (and, on the register backend, the chunk has
+// been lowered), so it can be called once per row of a batch.
+InterpretResult executeChunk(VM* vm, Chunk* chunk) {
+    MemoryStats* previous = useMemoryStats(&vm->memory);
+    InterpretResult result = executeOnVM(vm, chunk);
+    useMemoryStats(previous);
+    return result;
+}
+
+void releaseChunk(Chunk* chunk) {
+    freeChunk(chunk);
+    FREE(MEM_CHUNK, Chunk, chunk);
 }
 
 InterpretResult run(VM* vm) {
+// The top of the stack lives in a local for the whole loop. runChunk
+// reserved chunk->maxStackDepth slots, so pushes don't check for room
+// (debug builds still assert it). Stack.count is only brought up to date
+// where something outside the loop looks at the stack.
+    Value* stackTop = vm->stack.data + vm->stack.count;
+    bool canQuicken = vm->quicken && vm->chunk->mapping == NULL;
+
 // util macros
-#define BINARY_OP(RESULT_VAL, op)         \
-    do {                      \
-        if (!IS_NUMBER(peekStack(&vm->stack, 0)) || !IS_NUMBER(peekStack(&vm->stack, 1))) { \
-            runtimeError(vm, "Operands must be numbers."); \
-            return INTERPRET_RUNTIME_ERROR;             \
-        }                                               \
-        double b = AS_NUMBER(popStack(&vm->stack));     \
-        double a = AS_NUMBER(popStack(&vm->stack));     \
-        pushStack(&vm->stack, RESULT_VAL(a op b));      \
+#define PUSH(value) \
+    (assert(stackTop < vm->stack.data + vm->stack.capacity), *stackTop++ = (value))
+#define POP() (*--stackTop)
+#define PEEK(distance) (stackTop[-1 - (distance)])
+#define SYNC_STACK() (vm->stack.count = (uint32_t)(stackTop - vm->stack.data))
+
+#define BINARY_OP(RESULT_VAL, op, QUICKENED)                            \
+    do {                                                                \
+        if (!IS_NUMBER(PEEK(0)) || !IS_NUMBER(PEEK(1))) {               \
+            runtimeError(vm, "Operands must be numbers.");              \
+            return INTERPRET_RUNTIME_ERROR;                             \
+        }                                                               \
+        double b = AS_NUMBER(POP());                                    \
+        stackTop[-1] = RESULT_VAL(AS_NUMBER(stackTop[-1]) op b);        \
+        QUICKEN(QUICKENED);                                             \
+    } while (false)
+
+// Quickening: a generic operator that just ran on numbers rewrites its own
+// opcode to the _NUM form, which trades the per-operand checks for one
+// combined guard. Mapped .orc code is read-only and code shared with other
+// threads must not change under them, both stay generic.
+#define QUICKEN(QUICKENED)                                              \
+    do {                                                                \
+        if (canQuicken) {                                               \
+            vm->ip[-1] = (QUICKENED);                                   \
+        }                                                               \
+    } while (false)
+
+// On a guard miss the _NUM form turns back into the generic op and steps
+// ip back onto it, so the next dispatch redoes the instruction the slow
+// way (and raises its error, if any). Code that can't be rewritten runs
+// MISS in place instead, with a and b the operands.
+#define NUMBER_OP(RESULT_VAL, op, GENERIC, MISS)                        \
+    do {                                                                \
+        Value b = PEEK(0);                                              \
+        Value a = PEEK(1);                                              \
+        if (ARE_NUMBERS(a, b)) {                                        \
+            stackTop--;                                                 \
+            stackTop[-1] = RESULT_VAL(AS_NUMBER(a) op AS_NUMBER(b));    \
+        } else if (canQuicken) {                                        \
+            vm->ip[-1] = (GENERIC);                                     \
+            vm->ip--;                                                   \
+        } else {                                                        \
+            MISS;                                                       \
+        }                                                               \
+    } while (false)
+
+// the generic operators' miss: one operand is not a number
+#define OPERANDS_ERROR()                                                \
+    do {                                                                \
+        runtimeError(vm, "Operands must be numbers.");                  \
+        return INTERPRET_RUNTIME_ERROR;                                 \
+    } while (false)
+
+// superinstruction form: the right operand is the constant in the operand
+// byte instead of the top of the stack
+#define BINARY_CONST_OP(RESULT_VAL, op)                                 \
+    do {                                                                \
+        Value b = vm->chunk->constants.data[*vm->ip++];                 \
+        Value* a = stackTop - 1;                                        \
+        if (!IS_NUMBER(*a)) {                                           \
+            runtimeError(vm, "Operands must be numbers.");              \
+            return INTERPRET_RUNTIME_ERROR;                             \
+        }                                                               \
+        *a = RESULT_VAL(AS_NUMBER(*a) op AS_NUMBER(b));                 \
+    } while (false)
+
+// and with a small integer in the operand byte
+#define BINARY_IMM_OP(RESULT_VAL, op)                                   \
+    do {                                                                \
+        double b = (int8_t)*vm->ip++;                                   \
+        Value* a = stackTop - 1;                                        \
+        if (!IS_NUMBER(*a)) {                                           \
+            runtimeError(vm, "Operands must be numbers.");              \
+            return INTERPRET_RUNTIME_ERROR;                             \
+        }                                                               \
+        *a = RESULT_VAL(AS_NUMBER(*a) op b);                            \
     } while (false)
 
 #define BINARY_LOGIC_OP(op) \
     do { \
-        Value b = popStack(&vm->stack); \
-        Value a = popStack(&vm->stack); \
-        pushStack(&vm->stack, BOOL_VAL(toBool(a) op toBool(b))); \
+        Value b = POP(); \
+        stackTop[-1] = BOOL_VAL(toBool(stackTop[-1]) op toBool(b)); \
     } while (false)
 
+#define READ_SHORT() \
+    (vm->ip += 2, (uint16_t)((vm->ip[-2] << 8) | vm->ip[-1]))
+
+#define READ_LONG() \
+    (vm->ip += 3, (uint32_t)((vm->ip[-3] << 16) | (vm->ip[-2] << 8) | vm->ip[-1]))
+
 #define THROW_IF_NAN(val)       \
     do {                        \
         if (!IS_NUMBER(val)) {  \
@@ -66,145 +240,447 @@ InterpretResult run(VM* vm) {
             return INTERPRET_RUNTIME_ERROR;                 \
         }                       \
     } while (false)
-// util macros end
 
-    for (;;) {
-        uint8_t instruction = *vm->ip;
 #ifdef DEBUG
-        showStack(&vm->stack);
-        int offset = (int)(vm->ip - vm->chunk->data);
-        disassembleInstruction(vm->chunk, offset);
+#define TRACE_INSTRUCTION()                                         \
+    do {                                                            \
+        SYNC_STACK();                                               \
+        showStack(&vm->stack);                                      \
+        disassembleInstruction(vm->chunk, (int)(vm->ip - vm->chunk->data)); \
+    } while (false)
+#else
+#define TRACE_INSTRUCTION() do { } while (false)
+#endif
+
+#ifdef COUNT_INSTRUCTIONS
+#define COUNT_INSTRUCTION() (vm->instructionCount++)
+#else
+#define COUNT_INSTRUCTION() do { } while (false)
+#endif
+
+#ifdef TRACE
+#define RECORD_INSTRUCTION()                                                \
+    traceInstruction(&vm->trace, *vm->ip, (uint32_t)(vm->ip - vm->chunk->data), \
+                     (uint32_t)(stackTop - vm->stack.data),                 \
+                     stackTop > vm->stack.data ? stackTop[-1] : NIL_VAL)
+#else
+#define RECORD_INSTRUCTION() do { } while (false)
+#endif
+
+#ifdef PROFILE
+#define PROFILE_INSTRUCTION() \
+    profileInstruction(&vm->profile, *vm->ip, (int32_t)(vm->ip - vm->chunk->data))
+#else
+#define PROFILE_INSTRUCTION() do { } while (false)
 #endif
 
-        vm->ip++;
+// Threaded dispatch: every handler ends in its own indirect jump through
+// dispatchTable, which gives the branch predictor one site per opcode instead
+// of the single shared jump of the switch. Needs GCC/Clang labels-as-values,
+// so the switch below stays as the portable fallback.
+#ifdef COMPUTED_GOTO
+    static void* dispatchTable[] = {
+        [OP_RET]           = &&CASE_OP_RET,
+        [OP_NIL]           = &&CASE_OP_NIL,
+        [OP_CONSTANT]      = &&CASE_OP_CONSTANT,
+        [OP_CONSTANT_LONG] = &&CASE_OP_CONSTANT_LONG,
+        [OP_ZERO]          = &&CASE_OP_ZERO,
+        [OP_ONE]           = &&CASE_OP_ONE,
+        [OP_PUSH_I8]       = &&CASE_OP_PUSH_I8,
+        [OP_PUSH_I16]      = &&CASE_OP_PUSH_I16,
+        [OP_GET_INPUT]     = &&CASE_OP_GET_INPUT,
+        [OP_POP]           = &&CASE_OP_POP,
+        [OP_JUMP]          = &&CASE_OP_JUMP,
+        [OP_JUMP_IF_FALSE] = &&CASE_OP_JUMP_IF_FALSE,
+        [OP_JUMP_IF_TRUE]  = &&CASE_OP_JUMP_IF_TRUE,
+        [OP_TRUE]          = &&CASE_OP_TRUE,
+        [OP_FALSE]         = &&CASE_OP_FALSE,
+        [OP_NOT]           = &&CASE_OP_NOT,
+        [OP_TO_BOOL]       = &&CASE_OP_TO_BOOL,
+        [OP_XOR]           = &&CASE_OP_XOR,
+        [OP_EQUAL]         = &&CASE_OP_EQUAL,
+        [OP_NOT_EQUAL]     = &&CASE_OP_NOT_EQUAL,
+        [OP_GREATER]       = &&CASE_OP_GREATER,
+        [OP_LESS]          = &&CASE_OP_LESS,
+        [OP_GREATER_EQUAL] = &&CASE_OP_GREATER_EQUAL,
+        [OP_LESS_EQUAL]    = &&CASE_OP_LESS_EQUAL,
+        [OP_NEGATE]        = &&CASE_OP_NEGATE,
+        [OP_INC]           = &&CASE_OP_INC,
+        [OP_DEC]           = &&CASE_OP_DEC,
+        [OP_ADD]           = &&CASE_OP_ADD,
+        [OP_SUB]           = &&CASE_OP_SUB,
+        [OP_MULT]          = &&CASE_OP_MULT,
+        [OP_DIV]           = &&CASE_OP_DIV,
+        [OP_ADD_CONST]     = &&CASE_OP_ADD_CONST,
+        [OP_SUB_CONST]     = &&CASE_OP_SUB_CONST,
+        [OP_MULT_CONST]    = &&CASE_OP_MULT_CONST,
+        [OP_DIV_CONST]     = &&CASE_OP_DIV_CONST,
+        [OP_GREATER_CONST] = &&CASE_OP_GREATER_CONST,
+        [OP_LESS_CONST]    = &&CASE_OP_LESS_CONST,
+        [OP_GREATER_EQUAL_CONST] = &&CASE_OP_GREATER_EQUAL_CONST,
+        [OP_LESS_EQUAL_CONST]    = &&CASE_OP_LESS_EQUAL_CONST,
+        [OP_ADD_IMM]       = &&CASE_OP_ADD_IMM,
+        [OP_SUB_IMM]       = &&CASE_OP_SUB_IMM,
+        [OP_MULT_IMM]      = &&CASE_OP_MULT_IMM,
+        [OP_DIV_IMM]       = &&CASE_OP_DIV_IMM,
+        [OP_GREATER_IMM]   = &&CASE_OP_GREATER_IMM,
+        [OP_LESS_IMM]      = &&CASE_OP_LESS_IMM,
+        [OP_GREATER_EQUAL_IMM] = &&CASE_OP_GREATER_EQUAL_IMM,
+        [OP_LESS_EQUAL_IMM] = &&CASE_OP_LESS_EQUAL_IMM,
+        [OP_ADD_NUM] = &&CASE_OP_ADD_NUM,
+        [OP_SUB_NUM] = &&CASE_OP_SUB_NUM,
+        [OP_MULT_NUM] = &&CASE_OP_MULT_NUM,
+        [OP_DIV_NUM] = &&CASE_OP_DIV_NUM,
+        [OP_GREATER_NUM] = &&CASE_OP_GREATER_NUM,
+        [OP_LESS_NUM] = &&CASE_OP_LESS_NUM,
+        [OP_GREATER_EQUAL_NUM] = &&CASE_OP_GREATER_EQUAL_NUM,
+        [OP_LESS_EQUAL_NUM] = &&CASE_OP_LESS_EQUAL_NUM,
+        [OP_EQUAL_NUM] = &&CASE_OP_EQUAL_NUM,
+        [OP_NOT_EQUAL_NUM] = &&CASE_OP_NOT_EQUAL_NUM,
+    };
+
+#define DISPATCH()                              \
+    do {                                        \
+        TRACE_INSTRUCTION();                    \
+        COUNT_INSTRUCTION();                    \
+        PROFILE_INSTRUCTION();                  \
+        RECORD_INSTRUCTION();                   \
+        goto *dispatchTable[*vm->ip++];         \
+    } while (false)
+#define VM_CASE(op) CASE_##op:
+#define VM_BREAK DISPATCH()
+#else
+#define VM_CASE(op) case op:
+#define VM_BREAK break
+#endif
+// util macros end
+
+#ifdef COMPUTED_GOTO
+    DISPATCH();
+#else
+    for (;;) {
+        TRACE_INSTRUCTION();
+        COUNT_INSTRUCTION();
+        PROFILE_INSTRUCTION();
+        RECORD_INSTRUCTION();
+        uint8_t instruction = *vm->ip++;
         switch (instruction) {
-            case OP_RET: {
-                Value ret = popStack(&vm->stack);
-                switch (ret.type) {
-                    case VAL_BOOL:
-                        printf("%s\n", AS_BOOL(ret) ? "true" : "false");
-                        break;
-                    case VAL_NIL:
-                        printf("nil\n");
-                        break;
-                    case VAL_NUMBER:
-                        printf("%lf\n", AS_NUMBER(ret));
-                        break;
-                }
+#endif
+            VM_CASE(OP_RET) {
+                vm->result = POP();
+                SYNC_STACK();
                 return INTERPRET_OK;
             }
-            case OP_CONSTANT: {
+            VM_CASE(OP_CONSTANT) {
                 Value constant = vm->chunk->constants.data[*vm->ip];
                 THROW_IF_NAN(constant);
                 vm->ip++;
-                pushStack(&vm->stack, constant);
-                break;
+                PUSH(constant);
+                VM_BREAK;
             }
-            case OP_TRUE: {
-                pushStack(&vm->stack, BOOL_VAL(true));
-                break;
+            VM_CASE(OP_CONSTANT_LONG) {
+                Value constant = vm->chunk->constants.data[READ_LONG()];
+                THROW_IF_NAN(constant);
+                PUSH(constant);
+                VM_BREAK;
             }
-            case OP_FALSE: {
-                pushStack(&vm->stack, BOOL_VAL(false));
-                break;
+            VM_CASE(OP_ZERO) {
+                PUSH(NUMBER_VAL(0));
+                VM_BREAK;
             }
-            case OP_NIL: {
-                pushStack(&vm->stack, NIL_VAL);
-                break;
+            VM_CASE(OP_ONE) {
+                PUSH(NUMBER_VAL(1));
+                VM_BREAK;
             }
-            case OP_NEGATE: {
-                Value* val = peekStackReference(&vm->stack, 0);
-                THROW_IF_NAN(*val);
-                AS_NUMBER(*val) *= -1;
-                break;
+            VM_CASE(OP_PUSH_I8) {
+                PUSH(NUMBER_VAL((int8_t)*vm->ip++));
+                VM_BREAK;
             }
-            case OP_INC: {
-                Value* val = peekStackReference(&vm->stack, 0);
-                THROW_IF_NAN(*val);
-                AS_NUMBER(*val)++;
-                break;
+            VM_CASE(OP_PUSH_I16) {
+                PUSH(NUMBER_VAL((int16_t)READ_SHORT()));
+                VM_BREAK;
+            }
+            VM_CASE(OP_GET_INPUT) {
+                PUSH(vm->inputs[*vm->ip++]);
+                VM_BREAK;
+            }
+            VM_CASE(OP_POP) {
+                stackTop--;
+                VM_BREAK;
+            }
+            VM_CASE(OP_JUMP) {
+                uint16_t offset = READ_SHORT();
+                vm->ip += offset;
+                VM_BREAK;
+            }
+            VM_CASE(OP_JUMP_IF_FALSE) {
+                uint16_t offset = READ_SHORT();
+                if (isFalseyValue(PEEK(0))) {
+                    vm->ip += offset;
+                }
+                VM_BREAK;
             }
-            case OP_DEC: {
-                Value* val = peekStackReference(&vm->stack, 0);
+            VM_CASE(OP_JUMP_IF_TRUE) {
+                uint16_t offset = READ_SHORT();
+                if (!isFalseyValue(PEEK(0))) {
+                    vm->ip += offset;
+                }
+                VM_BREAK;
+            }
+            VM_CASE(OP_TRUE) {
+                PUSH(BOOL_VAL(true));
+                VM_BREAK;
+            }
+            VM_CASE(OP_FALSE) {
+                PUSH(BOOL_VAL(false));
+                VM_BREAK;
+            }
+            VM_CASE(OP_NIL) {
+                PUSH(NIL_VAL);
+                VM_BREAK;
+            }
+            VM_CASE(OP_NEGATE) {
+                Value* val = stackTop - 1;
                 THROW_IF_NAN(*val);
-                AS_NUMBER(*val)--;
-                break;
+                *val = NUMBER_VAL(-AS_NUMBER(*val));
+                VM_BREAK;
+            }
+            VM_CASE(OP_INC) {
+                Value* val = stackTop - 1;
+                if (!IS_NUMBER(*val)) {
+                    runtimeError(vm, "Operands must be numbers.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                *val = NUMBER_VAL(AS_NUMBER(*val) + 1);
+                VM_BREAK;
             }
-            case OP_NOT: {
-                pushStack(&vm->stack, BOOL_VAL(isFalseyValue(popStack(&vm->stack))));
-                break;
+            VM_CASE(OP_DEC) {
+                Value* val = stackTop - 1;
+                if (!IS_NUMBER(*val)) {
+                    runtimeError(vm, "Operands must be numbers.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                *val = NUMBER_VAL(AS_NUMBER(*val) - 1);
+                VM_BREAK;
             }
-            case OP_AND: {
-                BINARY_LOGIC_OP(&&);
-                break;
+            VM_CASE(OP_NOT) {
+                stackTop[-1] = BOOL_VAL(isFalseyValue(stackTop[-1]));
+                VM_BREAK;
             }
-            case OP_OR: {
-                BINARY_LOGIC_OP(||);
-                break;
+            VM_CASE(OP_TO_BOOL) {
+                Value* val = stackTop - 1;
+                *val = BOOL_VAL(toBool(*val));
+                VM_BREAK;
             }
-            case OP_XOR: {
+            VM_CASE(OP_XOR) {
                 BINARY_LOGIC_OP(^);
-                break;
+                VM_BREAK;
+            }
+            VM_CASE(OP_EQUAL) {
+                Value b = POP();
+                if (ARE_NUMBERS(stackTop[-1], b)) {
+                    QUICKEN(OP_EQUAL_NUM);
+                }
+                stackTop[-1] = BOOL_VAL(areValuesEqual(stackTop[-1], b));
+                VM_BREAK;
+            }
+            VM_CASE(OP_NOT_EQUAL) {
+                Value b = POP();
+                if (ARE_NUMBERS(stackTop[-1], b)) {
+                    QUICKEN(OP_NOT_EQUAL_NUM);
+                }
+                stackTop[-1] = BOOL_VAL(!areValuesEqual(stackTop[-1], b));
+                VM_BREAK;
+            }
+            VM_CASE(OP_GREATER_EQUAL) {
+                BINARY_OP(BOOL_VAL, >=, OP_GREATER_EQUAL_NUM);
+                VM_BREAK;
+            }
+            VM_CASE(OP_GREATER) {
+                BINARY_OP(BOOL_VAL, >, OP_GREATER_NUM);
+                VM_BREAK;
+            }
+            VM_CASE(OP_LESS_EQUAL) {
+                BINARY_OP(BOOL_VAL, <=, OP_LESS_EQUAL_NUM);
+                VM_BREAK;
+            }
+            VM_CASE(OP_LESS) {
+                BINARY_OP(BOOL_VAL, <, OP_LESS_NUM);
+                VM_BREAK;
+            }
+            VM_CASE(OP_ADD) {
+                BINARY_OP(NUMBER_VAL, +, OP_ADD_NUM);
+                VM_BREAK;
+            }
+            VM_CASE(OP_SUB) {
+                BINARY_OP(NUMBER_VAL, -, OP_SUB_NUM);
+                VM_BREAK;
+            }
+            VM_CASE(OP_MULT) {
+                BINARY_OP(NUMBER_VAL, *, OP_MULT_NUM);
+                VM_BREAK;
+            }
+            VM_CASE(OP_DIV) {
+                BINARY_OP(NUMBER_VAL, /, OP_DIV_NUM);
+                VM_BREAK;
+            }
+            VM_CASE(OP_ADD_CONST) {
+                BINARY_CONST_OP(NUMBER_VAL, +);
+                VM_BREAK;
+            }
+            VM_CASE(OP_SUB_CONST) {
+                BINARY_CONST_OP(NUMBER_VAL, -);
+                VM_BREAK;
+            }
+            VM_CASE(OP_MULT_CONST) {
+                BINARY_CONST_OP(NUMBER_VAL, *);
+                VM_BREAK;
+            }
+            VM_CASE(OP_DIV_CONST) {
+                BINARY_CONST_OP(NUMBER_VAL, /);
+                VM_BREAK;
             }
-            case OP_EQUAL: {
-                Value b = popStack(&vm->stack);
-                Value a = popStack(&vm->stack);
-                pushStack(&vm->stack, BOOL_VAL(areValuesEqual(a, b)));
-                break;
+            VM_CASE(OP_GREATER_CONST) {
+                BINARY_CONST_OP(BOOL_VAL, >);
+                VM_BREAK;
             }
-            case OP_NOT_EQUAL: {
-                Value b = popStack(&vm->stack);
-                Value a = popStack(&vm->stack);
-                pushStack(&vm->stack, BOOL_VAL(!areValuesEqual(a, b)));
-                break;
+            VM_CASE(OP_LESS_CONST) {
+                BINARY_CONST_OP(BOOL_VAL, <);
+                VM_BREAK;
             }
-            case OP_GREATER_EQUAL: {
-                BINARY_OP(BOOL_VAL, >);
-                break;
+            VM_CASE(OP_GREATER_EQUAL_CONST) {
+                BINARY_CONST_OP(BOOL_VAL, >=);
+                VM_BREAK;
             }
-            case OP_GREATER: {
-                BINARY_OP(BOOL_VAL, >);
-                break;
+            VM_CASE(OP_LESS_EQUAL_CONST) {
+                BINARY_CONST_OP(BOOL_VAL, <=);
+                VM_BREAK;
             }
-            case OP_LESS_EQUAL: {
-                BINARY_OP(BOOL_VAL, <=);
-                break;
+            VM_CASE(OP_ADD_IMM) {
+                BINARY_IMM_OP(NUMBER_VAL, +);
+                VM_BREAK;
             }
-            case OP_LESS: {
-                BINARY_OP(BOOL_VAL, <);
-                break;
+            VM_CASE(OP_SUB_IMM) {
+                BINARY_IMM_OP(NUMBER_VAL, -);
+                VM_BREAK;
             }
-            case OP_ADD: {
-                BINARY_OP(NUMBER_VAL, +);
-                break;
+            VM_CASE(OP_MULT_IMM) {
+                BINARY_IMM_OP(NUMBER_VAL, *);
+                VM_BREAK;
             }
-            case OP_SUB: {
-                BINARY_OP(NUMBER_VAL, -);
-                break;
+            VM_CASE(OP_DIV_IMM) {
+                BINARY_IMM_OP(NUMBER_VAL, /);
+                VM_BREAK;
             }
-            case OP_MULT: {
-                BINARY_OP(NUMBER_VAL, *);
-                break;
+            VM_CASE(OP_GREATER_IMM) {
+                BINARY_IMM_OP(BOOL_VAL, >);
+                VM_BREAK;
             }
-            case OP_DIV: {
-                BINARY_OP(NUMBER_VAL, /);
-                break;
+            VM_CASE(OP_LESS_IMM) {
+                BINARY_IMM_OP(BOOL_VAL, <);
+                VM_BREAK;
             }
+            VM_CASE(OP_GREATER_EQUAL_IMM) {
+                BINARY_IMM_OP(BOOL_VAL, >=);
+                VM_BREAK;
+            }
+            VM_CASE(OP_LESS_EQUAL_IMM) {
+                BINARY_IMM_OP(BOOL_VAL, <=);
+                VM_BREAK;
+            }
+            VM_CASE(OP_ADD_NUM) {
+                NUMBER_OP(NUMBER_VAL, +, OP_ADD, OPERANDS_ERROR());
+                VM_BREAK;
+            }
+            VM_CASE(OP_SUB_NUM) {
+                NUMBER_OP(NUMBER_VAL, -, OP_SUB, OPERANDS_ERROR());
+                VM_BREAK;
+            }
+            VM_CASE(OP_MULT_NUM) {
+                NUMBER_OP(NUMBER_VAL, *, OP_MULT, OPERANDS_ERROR());
+                VM_BREAK;
+            }
+            VM_CASE(OP_DIV_NUM) {
+                NUMBER_OP(NUMBER_VAL, /, OP_DIV, OPERANDS_ERROR());
+                VM_BREAK;
+            }
+            VM_CASE(OP_GREATER_NUM) {
+                NUMBER_OP(BOOL_VAL, >, OP_GREATER, OPERANDS_ERROR());
+                VM_BREAK;
+            }
+            VM_CASE(OP_LESS_NUM) {
+                NUMBER_OP(BOOL_VAL, <, OP_LESS, OPERANDS_ERROR());
+                VM_BREAK;
+            }
+            VM_CASE(OP_GREATER_EQUAL_NUM) {
+                NUMBER_OP(BOOL_VAL, >=, OP_GREATER_EQUAL, OPERANDS_ERROR());
+                VM_BREAK;
+            }
+            VM_CASE(OP_LESS_EQUAL_NUM) {
+                NUMBER_OP(BOOL_VAL, <=, OP_LESS_EQUAL, OPERANDS_ERROR());
+                VM_BREAK;
+            }
+            VM_CASE(OP_EQUAL_NUM) {
+                NUMBER_OP(BOOL_VAL, ==, OP_EQUAL,
+                          (stackTop--, stackTop[-1] = BOOL_VAL(areValuesEqual(a, b))));
+                VM_BREAK;
+            }
+            VM_CASE(OP_NOT_EQUAL_NUM) {
+                NUMBER_OP(BOOL_VAL, !=, OP_NOT_EQUAL,
+                          (stackTop--, stackTop[-1] = BOOL_VAL(!areValuesEqual(a, b))));
+                VM_BREAK;
+            }
+#ifndef COMPUTED_GOTO
         }
     }
+#endif
 
+#undef PUSH
+#undef POP
+#undef PEEK
+#undef SYNC_STACK
 #undef BINARY_OP
+#undef QUICKEN
+#undef NUMBER_OP
+#undef OPERANDS_ERROR
+#undef BINARY_CONST_OP
+#undef BINARY_IMM_OP
+#undef BINARY_LOGIC_OP
+#undef READ_SHORT
+#undef READ_LONG
+#undef THROW_IF_NAN
+#undef TRACE_INSTRUCTION
+#undef COUNT_INSTRUCTION
+#undef PROFILE_INSTRUCTION
+#undef RECORD_INSTRUCTION
+#undef DISPATCH
+#undef VM_CASE
+#undef VM_BREAK
 }
 
 void freeVM(VM* vm) {
-    free(vm->stack.data);
+    MemoryStats* previous = useMemoryStats(&vm->memory);
+#ifdef PROFILE
+    dumpProfile(&vm->profile, stderr);
+    freeProfile(&vm->profile);
+#endif
+#ifdef TRACE
+    freeTrace(&vm->trace);
+#endif
+    FREE_ARRAY(MEM_STACK, Value, vm->stack.data, vm->stack.capacity);
     vm->stack.data = NULL;
+    useMemoryStats(previous);
+}
+
+MemoryStats* vmMemoryStats(VM* vm) {
+    return &vm->memory;
 }
 
 void pushStack(Stack* stack, Value value) {
     if (isStackFull(stack)) {
         stack->capacity *= 2;
-        stack->data = GROW_ARRAY(Value, stack->data, stack->capacity);
+        stack->data =
+            GROW_ARRAY(MEM_STACK, Value, stack->data, stack->capacity / 2, stack->capacity);
     }
 
     stack->data[stack->count] = value;
@@ -228,6 +704,19 @@ Value* peekStackReference(Stack* stack, int distance) {
     return stack->data + (stack->count - 1 - distance);
 }
 
+// makes room for `depth` values without moving count
+void reserveStack(Stack* stack, uint32_t depth) {
+    if (stack->capacity >= depth) {
+        return;
+    }
+
+    uint32_t oldCapacity = stack->capacity;
+    while (stack->capacity < depth) {
+        stack->capacity *= 2;
+    }
+    stack->data = GROW_ARRAY(MEM_STACK, Value, stack->data, oldCapacity, stack->capacity);
+}
+
 bool isStackEmpty(Stack* stack) { return stack->count == 0; }
 bool isStackFull(Stack* stack) { return stack->count == stack->capacity; }
 
@@ -235,24 +724,7 @@ void showStack(Stack* stack) {
     for (Value* slot = stack->data; slot != (stack->data + stack->count);
          ++slot) {
         printf("[ ");
-        switch (slot->type) {
-            case VAL_BOOL:
-                if (AS_BOOL(*slot)) {
-                    printf("true");
-                }
-                else {
-                    printf("false");
-                }
-                break;
-            case VAL_NIL:
-                printf("nil");
-                break;
-            case VAL_NUMBER:
-                printf("%lf", AS_NUMBER(*slot));
-                break;
-            default:
-                printf("unrecognized");
-        }
+        printValue(*slot);
         printf(" ]\n");
     }
 
@@ -264,15 +736,29 @@ void resetStack(Stack* stack) {
 }
 
 void runtimeError(VM* vm, const char* format, ...) {
+    if (vm->diagnostics == NULL) {
+        resetStack(&vm->stack);
+        return;
+    }
+
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    vfprintf(vm->diagnostics, format, args);
     va_end(args);
-    fputc('\n', stderr);
+    fputc('\n', vm->diagnostics);
 
     size_t instruction = (vm->ip - vm->chunk->data) - 1;
-    int line = vm->chunk->lines[instruction];
-    fprintf(stderr, "[line %d] in script\n", line);
+    int line = getLine(vm->chunk, (int)instruction);
+    fprintf(vm->diagnostics, "[line %d] in script\n", line);
+#ifdef TRACE
+    const char* tracePath = getenv("ORION_TRACE");
+    if (tracePath == NULL) {
+        tracePath = TRACE_FILE;
+    }
+    if (dumpTrace(&vm->trace, vm->chunk, tracePath)) {
+        fprintf(vm->diagnostics, "[trace] last instructions written to %s\n", tracePath);
+    }
+#endif
     resetStack(&vm->stack);
 }
 